@@ -0,0 +1,218 @@
+#include "batch.h"
+#include "buffer.h"
+#include "operation.h"
+#include "rc.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct batch {
+	struct buffer *buf;
+	size_t cur;          // cursor offset
+	char *arg1;          // unescaped arguments of current command
+	char *arg2;
+};
+
+static char const * run_cmd(struct batch *b, char *line);
+static char const * cmd_subst(struct batch *b, char const *args);
+static size_t unescape(char *dst, char const *src, char delim,
+                       char const **end);
+
+int batch_run(char const *script, char const *fname)
+{
+	if (!script || !fname) {
+		fprintf(stderr, "edit: script and file are required\n");
+		return ERROR;
+	}
+
+	FILE *fp = strcmp(script, "-") ? fopen(script, "r") : stdin;
+	if (!fp) {
+		fprintf(stderr, "edit: can't open script %s\n", script);
+		return ERROR;
+	}
+
+	struct batch b = { create_buffer(), 0, NULL, NULL };
+	if (!b.buf) {
+		fprintf(stderr, "edit: can't create buffer\n");
+		if (fp != stdin)
+			fclose(fp);
+		return ERROR;
+	}
+	// nothing is shown, the indexes would only slow down edits
+	drop_indexes(b.buf);
+
+	bool ok = true;
+	if (file_exists(fname)) {
+		ok = (load_file(b.buf, fname) == SUCCESS);
+		if (!ok)
+			fprintf(stderr, "edit: can't load %s\n", fname);
+	} else {
+		snprintf(b.buf->filename, FNAMELEN_MAX, "%s", fname);
+	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	size_t line_no = 0;
+	ssize_t len;
+	while (ok && (len = getline(&line, &line_size, fp)) >= 0) {
+		line_no++;
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!len)
+			continue;
+
+		char *tmp1 = realloc(b.arg1, len + 1);
+		if (tmp1)
+			b.arg1 = tmp1;
+		char *tmp2 = realloc(b.arg2, len + 1);
+		if (tmp2)
+			b.arg2 = tmp2;
+		if (!tmp1 || !tmp2) {
+			fprintf(stderr, "edit: out of memory\n");
+			ok = false;
+			break;
+		}
+
+		char const *err = run_cmd(&b, line);
+		if (err) {
+			fprintf(stderr, "edit: %s:%zu: %s\n", script, line_no,
+			        err);
+			ok = false;
+		}
+	}
+
+	free(line);
+	free(b.arg1);
+	free(b.arg2);
+	delete_buffer(b.buf);
+	if (fp != stdin)
+		fclose(fp);
+
+	return (ok ? SUCCESS : ERROR);
+}
+
+// returns error message or NULL
+static char const * run_cmd(struct batch *b, char *line)
+{
+	struct buffer *buf = b->buf;
+	char const *args = line + 1;
+	while (*args == ' ')
+		args++;
+
+	char *end;
+	unsigned long long num;
+	long off;
+	size_t len;
+
+	switch (line[0]) {
+	case 'g':
+		num = strtoull(args, &end, 10);
+		if (end == args || !num)
+			return "wrong line number";
+		b->cur = ptr_to_off(buf, line_ptr(buf, num - 1));
+		break;
+	case 'o':
+		num = strtoull(args, &end, 10);
+		if (end == args)
+			return "wrong offset";
+		b->cur = num < buf_len(buf) ? num : buf_len(buf);
+		break;
+	case 'i':
+		len = unescape(b->arg1, args, '\0', NULL);
+		if (insert_bytes(buf, b->cur, b->arg1, len) != SUCCESS)
+			return "can't insert text";
+		b->cur += len;
+		break;
+	case 'd':
+		num = strtoull(args, &end, 10);
+		if (end == args)
+			return "wrong number of bytes";
+		delete_bytes(buf, b->cur, num);
+		break;
+	case '/':
+		len = unescape(b->arg1, line + 1, '\0', NULL);
+		if (len > FIND_MAX)
+			return "text is too long";
+		off = find_bytes(buf, b->cur, b->arg1, len);
+		if (off >= 0)
+			b->cur = off;
+		break;
+	case 's':
+		return cmd_subst(b, line + 1);
+	case 'w':
+		if (*args)
+			snprintf(buf->filename, FNAMELEN_MAX, "%s", args);
+		if (!strlen(buf->filename) || save(buf) != SUCCESS)
+			return "can't save file";
+		break;
+	default:
+		return "unknown command";
+	}
+
+	return NULL;
+}
+
+/*
+ * Replacing is done from left to right, so gap is only moved forward
+ * and text after it is contiguous: all replacements take one pass over
+ * the buffer.
+ */
+static char const * cmd_subst(struct batch *b, char const *args)
+{
+	char delim = *args;
+	if (!delim)
+		return "wrong s command";
+
+	char const *p = args + 1;
+	size_t old_len = unescape(b->arg1, p, delim, &p);
+	if (*p != delim)
+		return "wrong s command";
+	size_t new_len = unescape(b->arg2, p + 1, delim, &p);
+	bool all = (*p == delim && p[1] == 'g');
+
+	if (!old_len)
+		return "empty text to replace";
+	if (old_len > FIND_MAX)
+		return "text is too long";
+
+	size_t from = b->cur;
+	long off;
+	while ((off = find_bytes(b->buf, from, b->arg1, old_len)) >= 0) {
+		delete_bytes(b->buf, off, old_len);
+		if (insert_bytes(b->buf, off, b->arg2, new_len) != SUCCESS)
+			return "can't insert text";
+		from = off + new_len;
+		if (!all)
+			break;
+	}
+
+	return NULL;
+}
+
+// copy src to dst until unescaped delim, end is set to position of delim
+static size_t unescape(char *dst, char const *src, char delim,
+                       char const **end)
+{
+	size_t len = 0;
+	char const *p = src;
+	for (; *p && *p != delim; p++) {
+		if (*p == '\\' && p[1]) {
+			p++;
+			if (*p == 'n')
+				dst[len++] = '\n';
+			else if (*p == 't')
+				dst[len++] = '\t';
+			else
+				dst[len++] = *p;
+		} else {
+			dst[len++] = *p;
+		}
+	}
+
+	if (end)
+		*end = p;
+	return len;
+}
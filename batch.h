@@ -0,0 +1,23 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/*
+ * Non-interactive mode: commands are read one per line from script file
+ * ("-" for stdin) and applied to the file without starting ncurses.
+ *
+ * g LINE          move cursor to begin of line (from 1)
+ * o OFFSET        move cursor to byte offset (from 0)
+ * i TEXT          insert text at cursor, cursor is moved after it
+ * d BYTES         delete bytes at cursor
+ * /TEXT           move cursor to next occurrence of text
+ * s/OLD/NEW/[g]   replace next (or every with g) occurrence after cursor
+ * w [FILE]        save buffer to file
+ *
+ * TEXT could contain \n, \t and \\ escapes. In s command any symbol
+ * could be used instead of /.
+ */
+
+// run script on file, returns SUCCESS or ERROR
+int batch_run(char const *script, char const *fname);
+
+#endif /* BATCH_H */
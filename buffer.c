@@ -1,13 +1,57 @@
 #include "buffer.h"
+#include "journal.h"
+#include "lindex.h"
+#include "mark.h"
+#include "nest.h"
+#include "snap.h"
 #include "util.h"
+#include "words.h"
 #include "slog.h"
 #include "rc.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <ncurses.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// text that is saved, spaces at the end of what was seen so far are
+// held back until it's known if a line end follows them
+struct writer {
+	FILE *fp;
+	int eol;
+	int strip_ws;
+	char const *ws[2];    // held spaces, one run for each side of gap
+	size_t ws_len[2];
+	int ws_num;
+	int err;
+};
 
 static int inc_buffer_by_size(struct buffer *buf, size_t const inc_size);
+static uint32_t tail_sum(int fd, size_t size);
+static int reserve_gap(struct buffer *buf, size_t len);
+static void move_gap_to(struct buffer *buf, char *pos);
+static char * resize_mem(struct buffer *buf, size_t size);
+static void free_mem(struct buffer *buf);
+static long rss_kb(void);
+static size_t save_pos(struct buffer *buf);
+static void restore_pos(struct buffer *buf, size_t cursor);
+static void start_indexes(struct buffer *buf);
+static int detect_eol(char const *p, size_t len);
+static int all_crlf(char const *p, size_t len);
+static size_t drop_cr(char *p, size_t len);
+static void index_ins(struct buffer *buf, size_t off, char const *src,
+                      size_t len);
+static void index_del(struct buffer *buf, size_t off, size_t len);
+static void index_set(struct buffer *buf, size_t off, char const *src,
+                      size_t len);
+static void cow_range(struct buffer *buf, size_t off, size_t len);
+static void write_seg(struct writer *w, char const *p, size_t len);
+static void write_ws(struct writer *w);
+static void put(struct writer *w, char const *p, size_t len);
 
 struct buffer* create_buffer(void)
 {
@@ -30,10 +74,42 @@ struct buffer* create_buffer(void)
 	buf->cursor = buf->gap_e;
 	buf->size = buf_size;
 	buf->sel = NULL;
-	buf->copy_buf = NULL;
-	buf->copy_buf_size = 0;
+	memset(&buf->finfo, 0, sizeof(buf->finfo));
+	buf->jnl = NULL;
+	buf->follow = NULL;
+	buf->stream = NULL;
+	buf->mc = NULL;
+	buf->snaps = NULL;
+	buf->gap_reclaimed = 0;
+	buf->mapped = 0;
+	buf->lidx = NULL;
+	buf->words = NULL;
+	buf->nest = NULL;
+	buf->hex = 0;
+	buf->eol = EOL_LF;
+	buf->strip_ws = 0;
+	buf->cr_held = 0;
+	buf->no_index = 0;
+
+	buf->marks = marks_create();
+	if (!buf->marks) {
+		free(buf->buf_b);
+		free(buf);
+		return NULL;
+	}
+	buf->mk_disp_b = mark_new(buf->marks, 0);
+	buf->mk_disp_e = mark_new(buf->marks, 0);
+	buf->mk_sel = mark_new(buf->marks, 0);
+	if (!buf->mk_disp_b || !buf->mk_disp_e || !buf->mk_sel) {
+		marks_delete(buf->marks);
+		free(buf->buf_b);
+		free(buf);
+		return NULL;
+	}
 	strncpy(buf->filename, "\0", FNAMELEN_MAX);
 
+	start_indexes(buf);
+
 	return buf;
 }
 
@@ -42,10 +118,13 @@ void delete_buffer(struct buffer *buf)
 	if (!buf)
 		return;
 
+	lindex_stop(buf);
+	words_stop(buf);
+	nest_stop(buf);
 	if (buf->buf_b)
-		free(buf->buf_b);
+		free_mem(buf);
 
-	free_copy_buf(buf);
+	marks_delete(buf->marks);
 
 	free(buf);
 }
@@ -65,11 +144,17 @@ void log_buf(struct buffer const *buf)
 	log_si("buf->disp_b", (int)(uintptr_t)buf->disp_b);
 	log_si("buf->disp_e", (int)(uintptr_t)buf->disp_e);
 	log_si("buf->sel", (int)(uintptr_t)buf->sel);
-	log_si("buf->copy_buf", (int)(uintptr_t)buf->copy_buf);
-	log_si("buf->copy_buf_size", buf->copy_buf_size);
 	log_ss("log_buf e", "-------------------------------------");
 }
 
+void drop_indexes(struct buffer *buf)
+{
+	lindex_stop(buf);
+	words_stop(buf);
+	nest_stop(buf);
+	buf->no_index = 1;
+}
+
 int increase_buffer(struct buffer *buf)
 {
 	return inc_buffer_by_size(buf, INC_BUF_SIZE); 
@@ -80,6 +165,10 @@ int load_file(struct buffer *buf, char const *fname)
 	if (!buf || !fname || !strlen(fname))
 		return ERROR;
 
+	lindex_stop(buf);
+	words_stop(buf);
+	nest_stop(buf);
+
 	FILE *fp;
 	fp = fopen(fname, "r");
 	if (!fp)
@@ -87,23 +176,181 @@ int load_file(struct buffer *buf, char const *fname)
 
 	size_t fsize;
 	fsize = get_fsize(fname);
-	if (inc_buffer_by_size(buf, fsize) != SUCCESS) {
+	// the gap is the whole buffer here, on reload it is often enough
+	if (reserve_gap(buf, fsize) != SUCCESS) {
 		fclose(fp);
 		return ERROR;
 	}
-	
-	int bytes_read = fread(buf->buf_b, sizeof(char), fsize , fp);
-	if (bytes_read <= 0) {
+
+	size_t bytes_read = fread(buf->buf_b, sizeof(char), fsize , fp);
+	if (fsize && !bytes_read) {
 		fclose(fp);
 		return ERROR;
 	}
-	buf->gap_b += bytes_read;
 
-	strncpy(buf->filename, fname, FNAMELEN_MAX);
+	size_t probe = bytes_read < BINARY_PROBE ? bytes_read : BINARY_PROBE;
+	buf->hex = (memchr(buf->buf_b, '\0', probe) != NULL);
+	size_t len = bytes_read;
+	if (!buf->hex) {
+		buf->eol = detect_eol(buf->buf_b, bytes_read);
+		if (buf->eol == EOL_CRLF)
+			len = drop_cr(buf->buf_b, bytes_read);
+	}
+	buf->cr_held = 0;
+	buf->gap_b += len;
+	// empty text begin is restored after the gap when buffer is grown,
+	// the text is read before it, view and cursor are put back on it
+	buf->disp_b = buf->buf_b;
+	buf->cursor = off_to_ptr(buf, 0);
+	buf->changes++;
+
+	if (buf->filename != fname)
+		snprintf(buf->filename, FNAMELEN_MAX, "%s", fname);
 	fclose(fp);
+
+	update_finfo(buf, bytes_read);
+	start_indexes(buf);
 	return SUCCESS;
 }
 
+void update_finfo(struct buffer *buf, size_t size)
+{
+	memset(&buf->finfo, 0, sizeof(buf->finfo));
+
+	int fd = open(buf->filename, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		buf->finfo.size = size;
+		buf->finfo.mtime = st.st_mtime;
+		buf->finfo.ino = st.st_ino;
+		buf->finfo.dev = st.st_dev;
+		buf->finfo.tail_sum = tail_sum(fd, size);
+	}
+	close(fd);
+}
+
+int file_changed(struct buffer const *buf)
+{
+	if (!strlen(buf->filename))
+		return FILE_SAME;
+
+	int fd = open(buf->filename, O_RDONLY);
+	if (fd < 0)
+		return buf->finfo.ino ? FILE_CHANGED : FILE_SAME;
+
+	int ret = FILE_CHANGED;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_ino != buf->finfo.ino
+	    || st.st_dev != buf->finfo.dev) {
+		ret = FILE_CHANGED;
+	} else if ((size_t)st.st_size == buf->finfo.size
+	           && st.st_mtime == buf->finfo.mtime) {
+		ret = FILE_SAME;
+	} else if ((size_t)st.st_size > buf->finfo.size
+	           && tail_sum(fd, buf->finfo.size) == buf->finfo.tail_sum) {
+		ret = FILE_APPENDED;
+	}
+	close(fd);
+
+	return ret;
+}
+
+int reload_file(struct buffer *buf)
+{
+	int change = file_changed(buf);
+	if (change == FILE_SAME)
+		return SUCCESS;
+
+	if (change == FILE_CHANGED)
+		return reread_file(buf);
+
+	int fd = open(buf->filename, O_RDONLY);
+	if (fd < 0)
+		return ERROR;
+
+	struct stat st;
+	int ret = ERROR;
+	if (fstat(fd, &st) == 0) {
+		long bytes = append_from_fd(buf, fd, buf->finfo.size,
+		                            st.st_size - buf->finfo.size);
+		if (bytes >= 0) {
+			update_finfo(buf, buf->finfo.size + bytes);
+			ret = SUCCESS;
+		}
+	}
+	close(fd);
+
+	return ret;
+}
+
+int reread_file(struct buffer *buf)
+{
+	lindex_stop(buf);
+	words_stop(buf);
+	nest_stop(buf);
+	snap_cow(buf, buf->buf_b, buf->buf_e);
+	buf->gap_b = buf->buf_b;
+	buf->gap_e = buf->buf_e;
+	buf->cursor = buf->gap_e;
+	buf->disp_b = buf->buf_b;
+	buf->sel = NULL;
+	if (!file_exists(buf->filename)) {
+		memset(&buf->finfo, 0, sizeof(buf->finfo));
+		buf->cr_held = 0;
+		buf->changes++;
+		start_indexes(buf);
+		return SUCCESS;
+	}
+	return load_file(buf, buf->filename);
+}
+
+/*
+ * Appended bytes are read after the held CR, if there is one. For text
+ * with dropped CRs, the new line ends should be CRLF too, as load_file
+ * would find them otherwise. CR at the end could be the half of CRLF
+ * that is not written yet, it's held until the next read.
+ */
+long append_from_fd(struct buffer *buf, int fd, size_t off, size_t len)
+{
+	char *dst = gap_at_end(buf, len + 1);
+	if (!dst)
+		return -1;
+
+	size_t held = buf->cr_held ? 1 : 0;
+	if (held)
+		dst[0] = '\r';
+
+	size_t total = 0;
+	while (total < len) {
+		ssize_t n = pread(fd, dst + held + total, len - total,
+		                  off + total);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		total += n;
+	}
+
+	// binary file has LF line end, so it isn't changed
+	size_t n = held + total;
+	if (buf->eol == EOL_CRLF) {
+		if (!all_crlf(dst, n)) {
+			log_ss("error", "append_from_fd line ends differ");
+			return -1;
+		}
+		buf->cr_held = (n && dst[n - 1] == '\r');
+		n = drop_cr(dst, n - (buf->cr_held ? 1 : 0));
+	} else {
+		buf->cr_held = 0;
+	}
+
+	commit_end(buf, n);
+	return (long)total;
+}
+
 int in_buf(struct buffer const *buf, char const *pos)
 {
 	return (buf->buf_b <= pos && pos < buf->buf_e);
@@ -119,27 +366,346 @@ void move_gap(struct buffer *buf)
 	if (buf->cursor == buf->gap_e)
 		return;
 
-	if (buf->cursor == buf->gap_b) {
-		buf->cursor = buf->gap_e;
+	char *pos = buf->cursor;
+	size_t cursor = save_pos(buf);
+	move_gap_to(buf, pos);
+	restore_pos(buf, cursor);
+	buf->cursor = buf->gap_e;
+}
+
+size_t buf_len(struct buffer const *buf)
+{
+	return buf->size - (buf->gap_e - buf->gap_b);
+}
+
+size_t ptr_to_off(struct buffer const *buf, char const *p)
+{
+	if (p <= buf->gap_b)
+		return p - buf->buf_b;
+	if (p < buf->gap_e)
+		return buf->gap_b - buf->buf_b;
+	return p - buf->buf_b - (buf->gap_e - buf->gap_b);
+}
+
+char * off_to_ptr(struct buffer const *buf, size_t off)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	if (off < before_gap)
+		return buf->buf_b + off;
+	if (off > buf_len(buf))
+		off = buf_len(buf);
+	return buf->gap_e + (off - before_gap);
+}
+
+char * off_to_pos(struct buffer const *buf, size_t off)
+{
+	if (off == (size_t)(buf->gap_b - buf->buf_b))
+		return buf->gap_b;
+	return off_to_ptr(buf, off);
+}
+
+int insert_bytes(struct buffer *buf, size_t off, char const *src, 
+                 size_t len)
+{
+	if (!len)
+		return SUCCESS;
+
+	if (reserve_gap(buf, len) != SUCCESS)
+		return ERROR;
+
+	size_t cursor = save_pos(buf);
+
+	move_gap_to(buf, off_to_ptr(buf, off));
+	text_ins(buf, off, src, len);
+	memcpy(buf->gap_b, src, len);
+	buf->gap_b += len;
+
+	if (cursor >= off)
+		cursor += len;
+	restore_pos(buf, cursor);
+
+	return SUCCESS;
+}
+
+void delete_bytes(struct buffer *buf, size_t off, size_t len)
+{
+	size_t text_len = buf_len(buf);
+	if (off >= text_len || !len)
+		return;
+	if (len > text_len - off)
+		len = text_len - off;
+
+	size_t cursor = save_pos(buf);
+
+	move_gap_to(buf, off_to_ptr(buf, off));
+	text_del(buf, off, len);
+	buf->gap_e += len;
+
+	if (cursor >= off + len)
+		cursor -= len;
+	else if (cursor > off)
+		cursor = off;
+	restore_pos(buf, cursor);
+	reclaim_gap(buf);
+}
+
+/*
+ * Gap is moved once, the old bytes are taken into it and the new ones
+ * are put right at its begin.
+ */
+int replace_bytes(struct buffer *buf, size_t off, size_t len,
+                  char const *src, size_t src_len)
+{
+	size_t text_len = buf_len(buf);
+	if (off > text_len)
+		return ERROR;
+	if (len > text_len - off)
+		len = text_len - off;
+
+	if (src_len > len && reserve_gap(buf, src_len - len) != SUCCESS)
+		return ERROR;
+
+	size_t cursor = save_pos(buf);
+
+	move_gap_to(buf, off_to_ptr(buf, off));
+	text_del(buf, off, len);
+	buf->gap_e += len;
+
+	text_ins(buf, off, src, src_len);
+	memcpy(buf->gap_b, src, src_len);
+	buf->gap_b += src_len;
+
+	if (cursor >= off + len)
+		cursor = cursor - len + src_len;
+	else if (cursor > off)
+		cursor = off;
+	restore_pos(buf, cursor);
+	reclaim_gap(buf);
+
+	return SUCCESS;
+}
+
+/*
+ * Offsets are handled from left to right, so gap is moved only forward
+ * and all insertions cost one pass over the text between first and last
+ * offset. Each offset is shifted by sum of lengths inserted before it.
+ */
+int insert_multi(struct buffer *buf, size_t *offs, size_t num,
+                 char const *src, size_t len)
+{
+	if (!num || !len)
+		return SUCCESS;
+
+	if (reserve_gap(buf, num * len) != SUCCESS)
+		return ERROR;
+
+	save_pos(buf);
+
+	size_t shift = 0;
+	for (size_t i = 0; i < num; i++) {
+		size_t off = offs[i] + shift;
+		move_gap_to(buf, off_to_ptr(buf, off));
+		text_ins(buf, off, src, len);
+		memcpy(buf->gap_b, src, len);
+		buf->gap_b += len;
+
+		shift += len;
+		offs[i] = off + len;
+	}
+
+	restore_pos(buf, offs[num - 1]);
+	return SUCCESS;
+}
+
+void delete_multi(struct buffer *buf, size_t *offs, size_t const *lens,
+                  size_t num)
+{
+	if (!num)
 		return;
+
+	save_pos(buf);
+
+	size_t shift = 0;
+	for (size_t i = 0; i < num; i++) {
+		size_t off = offs[i] - shift;
+		move_gap_to(buf, off_to_ptr(buf, off));
+		text_del(buf, off, lens[i]);
+		buf->gap_e += lens[i];
+
+		shift += lens[i];
+		offs[i] = off;
 	}
 
-	if (buf->cursor < buf->gap_b) {
-		int chunk_size = buf->gap_b - buf->cursor;
+	buf->sel = NULL;
+	restore_pos(buf, offs[num - 1]);
+	reclaim_gap(buf);
+}
 
-		buf->gap_b -= chunk_size;
-		buf->gap_e -= chunk_size;
-		buf->cursor = buf->gap_e;
+/*
+ * Everything that follows the text is told about an edit here: journal,
+ * line, word and bracket indexes, marks and snapshots. Indexes look at
+ * the text around the edit, so these are called before it's changed.
+ */
+void text_ins(struct buffer *buf, size_t off, char const *src, size_t len)
+{
+	journal_ins(buf->jnl, off, src, len);
+	index_ins(buf, off, src, len);
+	marks_ins(buf->marks, off, len);
+}
 
-		memmove(buf->gap_e, buf->gap_b, sizeof(char) * chunk_size); 
-	} else {
-		int chunk_size = buf->cursor - buf->gap_e;
+void text_del(struct buffer *buf, size_t off, size_t len)
+{
+	journal_del(buf->jnl, off, len);
+	index_del(buf, off, len);
+	marks_del(buf->marks, off, len);
+	cow_range(buf, off, len);
+}
 
-		memmove(buf->gap_b, buf->gap_e, sizeof(char) * chunk_size);
+/*
+ * Byte is changed where it is, so editing far from the gap doesn't move
+ * the text between. Indexes see it as deletion and insertion, marks
+ * keep their offsets.
+ */
+int set_bytes(struct buffer *buf, size_t off, char const *src, size_t len)
+{
+	size_t text_len = buf_len(buf);
+	if (off > text_len || len > text_len - off)
+		return ERROR;
+	if (!len)
+		return SUCCESS;
 
-		buf->gap_b += chunk_size;
-		buf->gap_e = buf->cursor;
+	journal_set(buf->jnl, off, src, len);
+	index_set(buf, off, src, len);
+	cow_range(buf, off, len);
+
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	size_t n = 0;
+	if (off < before_gap) {
+		n = before_gap - off < len ? before_gap - off : len;
+		memcpy(buf->buf_b + off, src, n);
 	}
+	if (n < len)
+		memcpy(buf->gap_e + (off + n - before_gap), src + n, len - n);
+
+	return SUCCESS;
+}
+
+long find_bytes(struct buffer const *buf, size_t from, char const *pat,
+                size_t len)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	size_t text_len = buf_len(buf);
+	if (!len || len > FIND_MAX || from + len > text_len)
+		return -1;
+
+	char const *p;
+	if (from < before_gap) {
+		p = memmem(buf->buf_b + from, before_gap - from, pat, len);
+		if (p)
+			return p - buf->buf_b;
+
+		// match that has gap inside it
+		char edge[2 * FIND_MAX];
+		size_t edge_b = before_gap - from < len - 1 
+		                ? before_gap - from : len - 1;
+		size_t edge_e = text_len - before_gap < len - 1
+		                ? text_len - before_gap : len - 1;
+		if (edge_b && edge_e) {
+			memcpy(edge, buf->gap_b - edge_b, edge_b);
+			memcpy(edge + edge_b, buf->gap_e, edge_e);
+			p = memmem(edge, edge_b + edge_e, pat, len);
+			if (p)
+				return before_gap - edge_b + (p - edge);
+		}
+		from = before_gap;
+	}
+
+	char const *start = buf->gap_e + (from - before_gap);
+	p = memmem(start, buf->buf_e - start, pat, len);
+	if (p)
+		return from + (p - start);
+
+	return -1;
+}
+
+char * gap_at_end(struct buffer *buf, size_t len)
+{
+	if (reserve_gap(buf, len) != SUCCESS)
+		return NULL;
+
+	if (buf->gap_e != buf->buf_e) {
+		size_t cursor = save_pos(buf);
+		move_gap_to(buf, buf->buf_e);
+		restore_pos(buf, cursor);
+	}
+
+	return buf->gap_b;
+}
+
+void commit_end(struct buffer *buf, size_t len)
+{
+	size_t cursor = save_pos(buf);
+	// the bytes are read from the file, they aren't journaled
+	index_ins(buf, buf->gap_b - buf->buf_b, buf->gap_b, len);
+	buf->gap_b += len;
+	restore_pos(buf, cursor);
+}
+
+/*
+ * If text after the gap is shorter than the memory to free, it is moved
+ * to the gap and buffer memory is shrunk. Otherwise moving would
+ * cost more than it frees, so only whole pages inside the gap are
+ * dropped, they are mapped again when the gap is filled.
+ */
+void reclaim_gap(struct buffer *buf)
+{
+	size_t gap = buf->gap_e - buf->gap_b;
+	if (gap < buf->gap_reclaimed)
+		buf->gap_reclaimed = gap;
+
+	size_t text_len = buf_len(buf);
+	if (gap < GAP_RECLAIM_MIN || gap <= text_len ||
+	    gap < 2 * buf->gap_reclaimed)
+		return;
+
+	lindex_wait(buf);
+	words_wait(buf);
+	long rss = rss_kb();
+
+	size_t keep = text_len / 4;
+	if (keep < INC_BUF_SIZE)
+		keep = INC_BUF_SIZE;
+
+	size_t after_gap = buf->buf_e - buf->gap_e;
+	if (after_gap <= gap - keep) {
+		size_t before_gap = buf->gap_b - buf->buf_b;
+		size_t cursor = save_pos(buf);
+
+		snap_cow(buf, buf->gap_e, buf->buf_e);
+		memmove(buf->gap_b + keep, buf->gap_e, after_gap);
+		buf->size -= gap - keep;
+		/* if it fails, the block is just larger than needed */
+		char *buf_b = resize_mem(buf, buf->size);
+		if (buf_b)
+			buf->buf_b = buf_b;
+
+		buf->buf_e = buf->buf_b + buf->size;
+		buf->gap_b = buf->buf_b + before_gap;
+		buf->gap_e = buf->gap_b + keep;
+		restore_pos(buf, cursor);
+		buf->gap_reclaimed = keep;
+	} else {
+		uintptr_t page = sysconf(_SC_PAGESIZE);
+		uintptr_t b = (uintptr_t)buf->gap_b + keep + page - 1;
+		b &= ~(page - 1);
+		uintptr_t e = (uintptr_t)buf->gap_e & ~(page - 1);
+		if (b < e && madvise((void *)b, e - b, MADV_DONTNEED))
+			log_ss("error", "reclaim_gap madvise fail");
+		buf->gap_reclaimed = gap;
+	}
+
+	log_si("reclaim_gap rss kb before", (int)rss);
+	log_si("reclaim_gap rss kb after", (int)rss_kb());
 }
 
 void log_buf_ch(struct buffer *buf, int num_chars)
@@ -157,22 +723,20 @@ int save(struct buffer const *buf)
                 log_ss("error", "save fopen fail");
                 return ERROR;
         }
+	setvbuf(fp, NULL, _IOFBF, SAVE_BLOCK);
 
-        size_t length;
-        length = buf->gap_b - buf->buf_b;
-	if (length) {
-        	if (fwrite(buf->buf_b, sizeof (char), length, fp) != length) {
-                	log_ss("error", "save wrong length before gap");
-                	return ERROR;
-        	}
+	struct writer w = {.fp = fp, .eol = buf->eol,
+	                   .strip_ws = buf->strip_ws};
+	write_seg(&w, buf->buf_b, buf->gap_b - buf->buf_b);
+	write_seg(&w, buf->gap_e, buf->buf_e - buf->gap_e);
+	if (buf->cr_held) {
+		write_ws(&w);
+		put(&w, "\r", 1);
 	}
-
-        length = buf->buf_e - buf->gap_e;
-	if (length) {
-        	if (fwrite(buf->gap_e, sizeof (char), length, fp) != length) {
-                	log_ss("error", "save wrong length after gap");
-                	return ERROR;
-        	}
+	if (w.err) {
+		log_ss("error", "save write fail");
+		fclose(fp);
+		return ERROR;
 	}
 
         if (fclose(fp) != 0) {
@@ -183,6 +747,96 @@ int save(struct buffer const *buf)
         return SUCCESS;
 }
 
+// CRLF only if all line ends are CRLF, text with mixed ones is kept as
+// it is, so it's saved without changes
+static int detect_eol(char const *p, size_t len)
+{
+	if (!memchr(p, '\n', len))
+		return EOL_LF;
+	return all_crlf(p, len) ? EOL_CRLF : EOL_LF;
+}
+
+static int all_crlf(char const *p, size_t len)
+{
+	char const *end = p + len;
+	char const *nl = p;
+	while ((nl = memchr(nl, '\n', end - nl))) {
+		if (nl == p || nl[-1] != '\r')
+			return 0;
+		nl++;
+	}
+	return 1;
+}
+
+// CR of each CRLF is dropped in place in one pass, memchr jumps from one
+// CR to the next and bytes between them are moved at once. Returns new
+// length
+static size_t drop_cr(char *p, size_t len)
+{
+	char const *src = p;
+	char const *end = p + len;
+	char *dst = p;
+	char const *cr;
+	while ((cr = memchr(src, '\r', end - src))) {
+		int pair = (cr + 1 < end && cr[1] == '\n');
+		char const *keep = pair ? cr : cr + 1;
+		if (dst != src)
+			memmove(dst, src, keep - src);
+		dst += keep - src;
+		src = cr + 1;
+	}
+	if (dst != src)
+		memmove(dst, src, end - src);
+	return dst - p + (end - src);
+}
+
+/*
+ * Text is written by lines that memchr finds. Spaces at the end of a
+ * line are held back, they're written only if the line goes on after
+ * them, so a line that is cut by the gap is stripped right.
+ */
+static void write_seg(struct writer *w, char const *p, size_t len)
+{
+	char const *end = p + len;
+	while (p < end && !w->err) {
+		char const *nl = memchr(p, '\n', end - p);
+		char const *e = nl ? nl : end;
+		char const *t = e;
+		if (w->strip_ws) {
+			while (t > p && (t[-1] == ' ' || t[-1] == '\t'))
+				t--;
+		}
+
+		if (t > p) {
+			write_ws(w);
+			put(w, p, t - p);
+		}
+		if (t < e) {
+			w->ws[w->ws_num] = t;
+			w->ws_len[w->ws_num++] = e - t;
+		}
+		if (nl) {
+			w->ws_num = 0;
+			put(w, w->eol == EOL_CRLF ? "\r\n" : "\n",
+			    w->eol == EOL_CRLF ? 2 : 1);
+		}
+		p = nl ? nl + 1 : end;
+	}
+}
+
+static void write_ws(struct writer *w)
+{
+	for (int i = 0; i < w->ws_num; i++)
+		put(w, w->ws[i], w->ws_len[i]);
+	w->ws_num = 0;
+}
+
+static void put(struct writer *w, char const *p, size_t len)
+{
+	if (!w->err && fwrite(p, sizeof(char), len, w->fp) != len)
+		w->err = 1;
+}
+
 void toggle_selection(struct buffer *buf)
 {
 	if (!buf->sel)
@@ -191,33 +845,17 @@ void toggle_selection(struct buffer *buf)
 		buf->sel = NULL;
 }
 
-void free_copy_buf(struct buffer *buf)
-{
-	buf->copy_buf_size = 0;
-	if (buf->copy_buf)
-		free(buf->copy_buf);
-}
-
 static int inc_buffer_by_size(struct buffer *buf, size_t const inc_size)
 {
-	int before_gap_size = buf->gap_b - buf->buf_b;
-	int after_gap_size = buf->buf_e - buf->gap_e;
-	int gap_size = buf->gap_e - buf->gap_b;
-	int disp_b_pos = buf->disp_b - buf->buf_b;
+	size_t before_gap_size = buf->gap_b - buf->buf_b;
+	size_t after_gap_size = buf->buf_e - buf->gap_e;
+	size_t gap_size = buf->gap_e - buf->gap_b;
 
-	int sel_index = -1;
-	if (buf->sel) {
-		sel_index = buf->sel <= buf->gap_b
-	                    ? buf->sel - buf->buf_b
-	                    : buf->sel - gap_size - buf->buf_b;
-	}
+	lindex_wait(buf);
+	words_wait(buf);
+	size_t cursor = save_pos(buf);
 
-	int cursor_index = buf->cursor <= buf->gap_b
-	                   ? buf->cursor - buf->buf_b
-	                   : buf->cursor - gap_size - buf->buf_b;
-
-	char *buf_inc = realloc(buf->buf_b, 
-	                        sizeof(char) * (buf->size + inc_size));
+	char *buf_inc = resize_mem(buf, buf->size + inc_size);
 	if (!buf_inc)
 		return ERROR;
 
@@ -226,23 +864,222 @@ static int inc_buffer_by_size(struct buffer *buf, size_t const inc_size)
 	buf->buf_e = buf->buf_b + buf->size;
 	buf->gap_b = buf->buf_b + before_gap_size;
 	buf->gap_e = buf->gap_b + gap_size;
-	buf->disp_b = buf->buf_b + disp_b_pos;
-
-	buf->cursor = (buf->buf_b + cursor_index) <= buf->gap_b
-	              ? buf->buf_b + cursor_index
-	              : buf->gap_e + (cursor_index - before_gap_size);
-
-	if (sel_index >= 0) {
-		buf->sel= (buf->buf_b + sel_index) <= buf->gap_b
-		          ? buf->buf_b + sel_index
-	                  : buf->gap_e + (sel_index - before_gap_size);
-	}
 
 	memmove(buf->gap_e + inc_size, buf->gap_e, 
 	        sizeof(char) * after_gap_size);
 
 	buf->gap_e += inc_size;
+	restore_pos(buf, cursor);
 
 	return SUCCESS;
 }
 
+/*
+ * Bulk operations grow buffer by part of its size, so series of them
+ * (like replacing all occurrences) do not copy text after gap each time.
+ */
+static int reserve_gap(struct buffer *buf, size_t len)
+{
+	size_t gap_size = buf->gap_e - buf->gap_b;
+	if (gap_size >= len)
+		return SUCCESS;
+
+	size_t inc = buf->size / 4;
+	if (inc < INC_BUF_SIZE)
+		inc = INC_BUF_SIZE;
+
+	return inc_buffer_by_size(buf, len - gap_size + inc);
+}
+
+static void move_gap_to(struct buffer *buf, char *pos)
+{
+	if (pos == buf->gap_e || pos == buf->gap_b)
+		return;
+
+	lindex_wait(buf);
+	words_wait(buf);
+
+	if (pos < buf->gap_b) {
+		size_t chunk_size = buf->gap_b - pos;
+
+		snap_cow(buf, pos, buf->gap_b);
+		buf->gap_b -= chunk_size;
+		buf->gap_e -= chunk_size;
+
+		memmove(buf->gap_e, buf->gap_b, sizeof(char) * chunk_size); 
+	} else {
+		size_t chunk_size = pos - buf->gap_e;
+
+		snap_cow(buf, buf->gap_e, pos);
+		memmove(buf->gap_b, buf->gap_e, sizeof(char) * chunk_size);
+
+		buf->gap_b += chunk_size;
+		buf->gap_e = pos;
+	}
+}
+
+/*
+ * Large buffers are kept in anonymous mapping, it's grown with mremap,
+ * that moves page table entries instead of copying the text, and it's
+ * backed by transparent hugepages, so memmove of gap over large text
+ * has less TLB misses. Size of the block is buf->size, size of the
+ * mapping is rounded up to pages. Old block stays valid if it fails.
+ */
+static char * resize_mem(struct buffer *buf, size_t size)
+{
+	snap_cow(buf, buf->buf_b, buf->buf_e);
+
+	size_t old_size = buf->buf_e - buf->buf_b;
+	if (!buf->mapped && (size < BUF_MAP_MIN || size <= old_size))
+		return realloc(buf->buf_b, size);
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t map_size = (size + page - 1) & ~(page - 1);
+	char *p;
+
+	if (buf->mapped) {
+		old_size = (old_size + page - 1) & ~(page - 1);
+		p = mremap(buf->buf_b, old_size, map_size, MREMAP_MAYMOVE);
+	} else {
+		p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+		         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (p == MAP_FAILED)
+		return NULL;
+
+	madvise(p, map_size, MADV_HUGEPAGE);
+	if (!buf->mapped) {
+		memcpy(p, buf->buf_b, old_size);
+		free(buf->buf_b);
+		buf->mapped = 1;
+	}
+	return p;
+}
+
+static void free_mem(struct buffer *buf)
+{
+	snap_cow(buf, buf->buf_b, buf->buf_e);
+	if (!buf->mapped) {
+		free(buf->buf_b);
+		return;
+	}
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	munmap(buf->buf_b, (buf->buf_e - buf->buf_b + page - 1) & ~(page - 1));
+}
+
+// resident memory of the process from /proc, -1 if it's unknown
+static long rss_kb(void)
+{
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return -1;
+
+	long size, resident;
+	int ok = (fscanf(fp, "%ld %ld", &size, &resident) == 2);
+	fclose(fp);
+	if (!ok)
+		return -1;
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void index_ins(struct buffer *buf, size_t off, char const *src,
+                      size_t len)
+{
+	buf->changes++;
+	lindex_ins(buf, off, src, len);
+	words_ins(buf, off, src, len);
+	nest_ins(buf, off, src, len);
+}
+
+static void index_del(struct buffer *buf, size_t off, size_t len)
+{
+	buf->changes++;
+	lindex_del(buf, off, len);
+	words_del(buf, off, len);
+	nest_del(buf, off, len);
+}
+
+// words are rewritten in one pass, the others see deletion and insertion
+static void index_set(struct buffer *buf, size_t off, char const *src,
+                      size_t len)
+{
+	buf->changes++;
+	lindex_del(buf, off, len);
+	lindex_ins(buf, off, src, len);
+	words_set(buf, off, src, len);
+	nest_del(buf, off, len);
+	nest_ins(buf, off, src, len);
+}
+
+// bytes of the range could be on both sides of the gap
+static void cow_range(struct buffer *buf, size_t off, size_t len)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	size_t end = off + len;
+	if (off < before_gap) {
+		size_t e = end < before_gap ? end : before_gap;
+		snap_cow(buf, buf->buf_b + off, buf->buf_b + e);
+	}
+	if (end > before_gap) {
+		size_t b = off > before_gap ? off - before_gap : 0;
+		snap_cow(buf, buf->gap_e + b, buf->gap_e + (end - before_gap));
+	}
+}
+
+static void start_indexes(struct buffer *buf)
+{
+	if (buf->no_index)
+		return;
+
+	if (lindex_start(buf) != SUCCESS)
+		log_ss("error", "lindex_start fail");
+	if (words_start(buf) != SUCCESS)
+		log_ss("error", "words_start fail");
+	if (nest_start(buf) != SUCCESS)
+		log_ss("error", "nest_start fail");
+}
+
+/*
+ * Pointers in buffer became invalid when gap is moved or memory is
+ * reallocated, so before that they are stored in marks (cursor offset
+ * is returned), and after that are taken from marks.
+ */
+static size_t save_pos(struct buffer *buf)
+{
+	mark_move(buf->marks, buf->mk_disp_b, ptr_to_off(buf, buf->disp_b));
+	if (buf->disp_e)
+		mark_move(buf->marks, buf->mk_disp_e,
+		          ptr_to_off(buf, buf->disp_e));
+	if (buf->sel)
+		mark_move(buf->marks, buf->mk_sel, ptr_to_off(buf, buf->sel));
+
+	return ptr_to_off(buf, buf->cursor);
+}
+
+static void restore_pos(struct buffer *buf, size_t cursor)
+{
+	buf->cursor = off_to_ptr(buf, cursor);
+	buf->disp_b = off_to_pos(buf, mark_off(buf->mk_disp_b));
+	if (buf->disp_e)
+		buf->disp_e = off_to_ptr(buf, mark_off(buf->mk_disp_e));
+	if (buf->sel)
+		buf->sel = off_to_pos(buf, mark_off(buf->mk_sel));
+}
+
+static uint32_t tail_sum(int fd, size_t size)
+{
+	char tail[FILE_TAIL_SIZE];
+	size_t len = size < FILE_TAIL_SIZE ? size : FILE_TAIL_SIZE;
+	ssize_t n = pread(fd, tail, len, size - len);
+	if (n < 0)
+		n = 0;
+
+	uint32_t sum = 2166136261u;
+	for (ssize_t i = 0; i < n; i++) {
+		sum ^= (unsigned char)tail[i];
+		sum *= 16777619u;
+	}
+	return sum;
+}
@@ -4,7 +4,42 @@
 #define FNAMELEN_MAX 70
 #define INIT_BUF_SIZE 1024
 #define INC_BUF_SIZE 1024
+#define FILE_TAIL_SIZE 4096
+#define FIND_MAX 256
+#define GAP_RECLAIM_MIN (1024 * 1024)
+#define BUF_MAP_MIN (64 * 1024 * 1024)
+#define BINARY_PROBE 4096    // file with zero byte there is binary
+#define SAVE_BLOCK (64 * 1024)
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
+
+#define FILE_SAME 0
+#define FILE_APPENDED 1
+#define FILE_CHANGED 2
+
+#define EOL_LF 0
+#define EOL_CRLF 1
+
+struct journal;
+struct follow;
+struct stream;
+struct mcursor;
+struct mark;
+struct mark_set;
+struct lindex;
+struct snap;
+struct words;
+struct nest;
+
+// state of the file on disk when it was loaded or saved
+struct file_info {
+	size_t size;         // bytes of the file that are in buffer
+	time_t mtime;
+	ino_t ino;           // 0 if there was no file
+	dev_t dev;
+	uint32_t tail_sum;   // checksum of last FILE_TAIL_SIZE bytes
+};
 
 struct buffer {
 	char *disp_b;        // first displayed byte
@@ -16,33 +51,139 @@ struct buffer {
         char *gap_b;         // start of gap
         char *gap_e;         // byte right after the last one byte in gap
         char *sel;           // selection start
-        char *copy_buf;      // start of copy buffer
-        size_t copy_buf_size;
         char filename[FNAMELEN_MAX];
+	struct file_info finfo;
+	struct journal *jnl; // crash-recovery journal, NULL if disabled
+	struct follow *follow; // follow mode state, NULL if disabled
+	struct stream *stream; // stdin that is being read, NULL if none
+	struct mcursor *mc;  // additional cursors, NULL if there are none
+	struct mark_set *marks;  // positions that are kept on text changes
+	struct mark *mk_disp_b;  // marks for pointers above, they are set
+	struct mark *mk_disp_e;  // and used when buffer memory is changed
+	struct mark *mk_sel;
+	size_t gap_reclaimed;    // gap size after its memory was reclaimed
+	int mapped;              // buffer memory is anonymous mapping
+	struct lindex *lidx;     // line index, NULL if text wasn't loaded
+	size_t changes;          // counter of text changes
+	struct snap *snaps;      // snapshots that point to buffer memory
+	struct words *words;     // word index, NULL if there is none
+	struct nest *nest;       // bracket nesting checkpoints
+	int hex;                 // text is shown as hex dump
+	int eol;                 // CRLF if all line ends of file are such,
+	                         // text has LF ones then
+	int cr_held;             // CR at the end of appended bytes, it's
+	                         // not in the text until next byte is read
+	int strip_ws;            // trailing spaces aren't saved to file
+	int no_index;            // line, word and bracket indexes are off
 }; 
 
 struct buffer* create_buffer(void);
 
-// return memory that was used for buffer and copy buffer
+// return memory that was used for buffer
 void delete_buffer(struct buffer *buf); 
 
+// stop line, word and bracket indexes and don't build them on load,
+// for text that is never shown
+void drop_indexes(struct buffer *buf);
+
 // increase buffer by INC_BUF_SIZE 
 int increase_buffer(struct buffer *buf);
 
-// load file to buffer and increase the buffer if nessessary
+// load file to buffer and increase the buffer if nessessary. File is
+// taken as CRLF only when every line end is CRLF, then CR is dropped
+// from them, binary file is shown as hex and kept as it is
 int load_file(struct buffer *buf, char const *fname);
 
+// remember mtime and inode of buffer file and that its first size 
+// bytes are in buffer
+void update_finfo(struct buffer *buf, size_t size);
+
+// check if file was changed on disk since it was loaded or saved.
+// returns FILE_SAME, FILE_APPENDED or FILE_CHANGED
+int file_changed(struct buffer const *buf);
+
+// reload file changed on disk, if bytes were only appended to it 
+// only they are read
+int reload_file(struct buffer *buf);
+
+// read whole file again, edits of the text are lost
+int reread_file(struct buffer *buf);
+
+// read len bytes from fd at offset to the end of text, CRLF is read as
+// LF like in load_file. returns number of bytes read from fd, -1 if they
+// can't be read or have other line ends than the text
+long append_from_fd(struct buffer *buf, int fd, size_t off, size_t len);
+
 int in_buf(struct buffer const *buf, char const *pos);
 int in_gap(struct buffer const *buf, char const *pos); 
 
 // move gap inside buffer
 void move_gap(struct buffer *buf); 
 
-// saving buffer to file
-int save(struct buffer const *buf);
+// number of text bytes in buffer (gap excluded)
+size_t buf_len(struct buffer const *buf);
+
+// convert pointer inside buffer to logical offset of text and back
+size_t ptr_to_off(struct buffer const *buf, char const *p);
+char * off_to_ptr(struct buffer const *buf, size_t off);
+
+// like off_to_ptr, but offset at the gap gives gap begin, so text inserted
+// there comes after the position, as it does for marks
+char * off_to_pos(struct buffer const *buf, size_t off);
 
-// return memory that was used for copy buffer
-void free_copy_buf(struct buffer *buf);
+// insert len bytes at logical offset, increase buffer if nessessary
+int insert_bytes(struct buffer *buf, size_t off, char const *src, 
+                 size_t len);
+
+// delete len bytes starting at logical offset
+void delete_bytes(struct buffer *buf, size_t off, size_t len);
+
+// replace len bytes at logical offset with src_len bytes of src as one
+// edit, cursor inside replaced range is moved to its begin
+int replace_bytes(struct buffer *buf, size_t off, size_t len,
+                  char const *src, size_t src_len);
+
+// overwrite len bytes at logical offset with ones of src without moving
+// the gap, the bytes should be in the text
+int set_bytes(struct buffer *buf, size_t off, char const *src, size_t len);
+
+// offset of first occurrence of len bytes of pat at or after offset from,
+// -1 if there is no such. pattern could be up to FIND_MAX bytes
+long find_bytes(struct buffer const *buf, size_t from, char const *pat,
+                size_t len);
+
+// insert len bytes at each of num sorted offsets in one pass of gap
+// over buffer. offsets are set to positions after inserted bytes
+int insert_multi(struct buffer *buf, size_t *offs, size_t num,
+                 char const *src, size_t len);
+
+// delete lens[i] bytes at each of num sorted offsets, ranges should
+// not overlap. offsets are set to positions of ranges after deletion
+void delete_multi(struct buffer *buf, size_t *offs, size_t const *lens,
+                  size_t num);
+
+// move gap to the end of text and make it at least len bytes long.
+// returns pointer to the gap or NULL, bytes written there are added 
+// to text with commit_end. cursor keeps its offset
+char * gap_at_end(struct buffer *buf, size_t len);
+void commit_end(struct buffer *buf, size_t len);
+
+// len bytes of src are inserted at offset, should be called before the
+// text is changed by any edit
+void text_ins(struct buffer *buf, size_t off, char const *src, size_t len);
+
+// len bytes at offset are deleted, should be called before the text is
+// changed, after the gap is moved to them
+void text_del(struct buffer *buf, size_t off, size_t len);
+
+// give memory of the gap back to system if gap is larger than text and
+// has at least doubled since last time, pointers are kept valid
+void reclaim_gap(struct buffer *buf);
+
+// saving buffer to file with its line ends, without trailing spaces and
+// tabs if strip_ws is set. Text is written as it goes, so the file could
+// differ from the text in length
+int save(struct buffer const *buf);
 
 // toggle selection mode on/off
 void toggle_selection(struct buffer *buf);
@@ -1,6 +1,10 @@
 #include "display.h"
+#include "lindex.h"
+#include "mcursor.h"
+#include "nest.h"
 #include "slog.h"
 #include "rc.h"
+#include "term.h"
 #include "util.h"
 #include "utf.h"
 
@@ -8,26 +12,92 @@
 #include <ncurses.h>
 #include <string.h>
 
-#define TAB_LEN 8
+static int display_hex(struct buffer *buf, WINDOW *win,
+                       struct disp_state *st, int rows, int cols);
+static int off_width(size_t len);
+static void draw_status(struct buffer *buf, WINDOW *win, int row, int cols);
+static int scroll_rows(struct buffer const *buf,
+                       struct disp_state const *st, size_t top);
+static char const * next_row(struct buffer const *buf, char const *p,
+                             int cols);
+static int symb_width(char const *p, int symb_size);
 
-int display(struct buffer *buf)
+/*
+ * When text wasn't changed and only the view is moved by a few rows, the
+ * screen is scrolled and only the rows that appear are drawn.
+ */
+int display(struct buffer *buf, WINDOW *win, struct disp_state *st)
 {
-	if (!buf)
+	if (!buf || !win)
 		return ERROR;
 
-	erase();
+	int rows, cols;
+	getmaxyx(win, rows, cols);
+	rows--;               // last row is status line
+
+	if (buf->hex)
+		return display_hex(buf, win, st, rows, cols);
+
+	size_t top = ptr_to_off(buf, buf->disp_b);
+	long match = nest_match(buf, ptr_to_off(buf, buf->cursor));
+	int plain = !buf->sel && !(buf->mc && buf->mc->num) && match < 0;
+	int draw_b = 0;
+	int draw_e = rows;
+
+	if (plain && st->plain && st->buf == buf
+	    && st->changes == buf->changes
+	    && st->rows == rows && st->cols == cols) {
+		int k = scroll_rows(buf, st, top);
+		if (k >= 0 && k < rows)
+			draw_b = rows - k;
+		else if (k < 0 && -k < rows)
+			draw_e = -k;
+
+		if (k && (draw_b || draw_e < rows)) {
+			wsetscrreg(win, 0, rows - 1);
+			scrollok(win, TRUE);
+			wscrl(win, k);
+			scrollok(win, FALSE);
+		}
+	}
+
+	if (!draw_b && draw_e == rows) {
+		werase(win);
+	} else {
+		for (int i = draw_b; i < draw_e; i++) {
+			wmove(win, i, 0);
+			wclrtoeol(win);
+		}
+	}
+
+	st->buf = buf;
+	st->top = top;
+	st->changes = buf->changes;
+	st->rows = rows;
+	st->cols = cols;
+	st->plain = plain;
 
 	int x = 0;
 	int y = 0;
+	int moved = -1;       // row the curses cursor was moved to
 	int cursor_x = 0;
 	int cursor_y = 0;
 	char str[UTF_BUF_SIZE] = {0};
 	char const *p = buf->disp_b;
 
-	while (p <= buf->buf_e && y < LINES) {
+	// bracket that matches one at cursor is shown bold
+	char const *match_p = match >= 0 ? off_to_ptr(buf, match) : NULL;
+
+	// additional cursors are shown as underlined symbols
+	size_t mc_i = 0;
+	size_t mc_num = buf->mc ? buf->mc->num : 0;
+	if (mc_num)
+		mc_i = mc_first_from(buf->mc, ptr_to_off(buf, p));
+
+	while (p <= buf->buf_e && y < rows) {
 		int x_inc = 0;
 
-		attroff(A_REVERSE);
+		wattroff(win, A_REVERSE);
 		if (buf->sel) {
 			char *sel_b = buf->sel;
 			char *sel_e = buf->cursor;
@@ -38,7 +108,7 @@ int display(struct buffer *buf)
 			}
 
 			if (sel_b <= p && p <= sel_e)
-				attron(A_REVERSE);
+				wattron(win, A_REVERSE);
 		}
 
 		if (buf->cursor == p) {
@@ -53,24 +123,47 @@ int display(struct buffer *buf)
 				cursor_x = x;
 				cursor_y = y;
 			}
+		}
+		if (p == buf->buf_e)
+			break;
+
+		wattroff(win, A_BOLD);
+		if (p == match_p)
+			wattron(win, A_BOLD);
 
-			if (p == buf->buf_e)
-				continue;
+		wattroff(win, A_UNDERLINE);
+		if (mc_i < mc_num && p < buf->buf_e) {
+			size_t off = ptr_to_off(buf, p);
+			while (mc_i < mc_num && buf->mc->off[mc_i] < off)
+				mc_i++;
+			if (mc_i < mc_num && buf->mc->off[mc_i] == off)
+				wattron(win, A_UNDERLINE);
 		}
 
 		int symb_size = get_symb_len(*p);
-		if (!symb_size) {
+		if (!symb_size)
 			return ERROR;
+
+		int draw = (y >= draw_b && y < draw_e);
+		if (draw && moved != y) {
+			wmove(win, y, x);
+			moved = y;
+		}
+
+		if (!draw) {
+			x_inc = symb_width(p, symb_size);
 		} else if (symb_size == 1) {
 			if (isprint(*p)) {
-				addch(*p);
+				waddch(win, *p);
 				x_inc = 1;
 			} else if (*p == '\n') {
-				addch(*p);
+				waddch(win, *p);
 				x_inc = 1;
 			} else if (*p == '\t') {
-				for (int i = 0; i < TAB_LEN; i++) {
-					addch(' ');
+				// tab is cut at row end, so rows don't
+				// spill to the next ones
+				for (int i = 0; i < TAB_LEN && x + i < cols; i++) {
+					waddch(win, ' ');
 				}
 				x_inc = TAB_LEN;
 			}
@@ -82,14 +175,14 @@ int display(struct buffer *buf)
 				str[i] = *(p + i);
 
 			if (strlen(str)) {
-				addstr(str);
+				waddstr(win, str);
 				x_inc = 1;	
 			}
 		}
 
 		x += x_inc;
 
-		if (x == COLS || *p == '\n') {
+		if (x >= cols || *p == '\n') {
 			y++;
 			x = 0;
 		}
@@ -98,9 +191,213 @@ int display(struct buffer *buf)
 	}
 	buf->disp_e = (char *)p;
 
-	move(cursor_y, cursor_x);
-        refresh();
+	draw_status(buf, win, rows, cols);
+	wmove(win, cursor_y, cursor_x);
+
+	return SUCCESS;
+}
+
+int hex_row_bytes(struct buffer const *buf, int cols)
+{
+	int w = off_width(buf_len(buf));
+	int n = HEX_ROW_MAX;
+	while (n > 1 && w + 2 + 4 * n + 1 > cols)
+		n /= 2;
+	return n;
+}
+
+/*
+ * Only bytes of the shown rows are read, right where they are in buffer
+ * memory, so a page costs the same in any place of a huge file. View is
+ * moved by rows to keep cursor on screen. Window is drawn whole each time.
+ */
+static int display_hex(struct buffer *buf, WINDOW *win,
+                       struct disp_state *st, int rows, int cols)
+{
+	size_t len = buf_len(buf);
+	size_t n = hex_row_bytes(buf, cols);
+	int w = off_width(len);
+	size_t cur = ptr_to_off(buf, buf->cursor);
+
+	size_t top = ptr_to_off(buf, buf->disp_b) / n * n;
+	if (cur < top)
+		top = cur / n * n;
+	else if (cur / n >= top / n + rows)
+		top = (cur / n - rows + 1) * n;
+	buf->disp_b = off_to_pos(buf, top);
+
+	size_t sel_b = SIZE_MAX, sel_e = 0;
+	if (buf->sel) {
+		sel_b = ptr_to_off(buf, buf->sel);
+		sel_e = cur;
+		if (sel_b > sel_e) {
+			sel_e = sel_b;
+			sel_b = cur;
+		}
+	}
+
+	werase(win);
+	int cursor_x = w + 2;
+	int cursor_y = 0;
+	for (int y = 0; y < rows; y++) {
+		size_t row = top + y * n;
+		if (row > len || (row == len && cur != len))
+			break;
+
+		mvwprintw(win, y, 0, "%0*zx", w, row);
+		for (size_t i = 0; i < n && row + i < len; i++) {
+			size_t off = row + i;
+			unsigned char ch = *off_to_ptr(buf, off);
+			int hex_x = w + 2 + 3 * i;
+			int asc_x = w + 2 + 3 * n + 1 + i;
+
+			if (sel_b <= off && off <= sel_e)
+				wattron(win, A_REVERSE);
+			mvwprintw(win, y, hex_x, "%02x", ch);
+			if (off == cur)
+				wattron(win, A_REVERSE);
+			mvwaddch(win, y, asc_x, isprint(ch) ? ch : '.');
+			wattroff(win, A_REVERSE);
+		}
+		if (cur >= row && cur < row + n) {
+			cursor_x = w + 2 + 3 * (cur - row);
+			cursor_y = y;
+		}
+	}
+
+	size_t end = top + rows * n;
+	buf->disp_e = off_to_ptr(buf, end < len ? end : len);
 
+	st->buf = buf;
+	st->top = top;
+	st->changes = buf->changes;
+	st->rows = rows;
+	st->cols = cols;
+	st->plain = 0;
+
+	draw_status(buf, win, rows, cols);
+	wmove(win, cursor_y, cursor_x);
 	return SUCCESS;
 }
 
+// hex digits of offsets, at least 8
+static int off_width(size_t len)
+{
+	int w = 8;
+	while (w < 16 && len >> (4 * w))
+		w++;
+	return w;
+}
+
+/*
+ * Number of rows the view was moved down since last display, negative
+ * if it was moved up, number of rows if it's too far or not on row begin.
+ */
+static int scroll_rows(struct buffer const *buf,
+                       struct disp_state const *st, size_t top)
+{
+	if (top == st->top)
+		return 0;
+
+	size_t from = top < st->top ? top : st->top;
+	size_t to = top < st->top ? st->top : top;
+	char const *p = off_to_ptr(buf, from);
+
+	for (int k = 1; k < st->rows; k++) {
+		p = next_row(buf, p, st->cols);
+		if (!p)
+			break;
+
+		size_t off = ptr_to_off(buf, p);
+		if (off == to)
+			return top > st->top ? k : -k;
+		if (off > to)
+			break;
+	}
+	return st->rows;
+}
+
+// begin of the row after the one at p, as display wraps them. NULL if
+// text ends on this row
+static char const * next_row(struct buffer const *buf, char const *p,
+                             int cols)
+{
+	int x = 0;
+	for (;;) {
+		if (in_gap(buf, p))
+			p = buf->gap_e;
+		if (p >= buf->buf_e)
+			return NULL;
+
+		int symb_size = get_symb_len(*p);
+		if (!symb_size)
+			return NULL;
+
+		x += symb_width(p, symb_size);
+		int end = (x >= cols || *p == '\n');
+		p += symb_size;
+		if (end)
+			return p;
+	}
+}
+
+static int symb_width(char const *p, int symb_size)
+{
+	if (symb_size > 1)
+		return 1;
+	if (isprint(*p) || *p == '\n')
+		return 1;
+	if (*p == '\t')
+		return TAB_LEN;
+	return 0;
+}
+
+/*
+ * Counters are kept by line index on each edit and cursor line is
+ * counted from its previous position, which scans the text between the
+ * two. Line index isn't used until its background counting is done,
+ * the first frame of a large file would wait for it otherwise.
+ */
+static void draw_status(struct buffer *buf, WINDOW *win, int row, int cols)
+{
+	size_t len = buf_len(buf);
+	size_t off = ptr_to_off(buf, buf->cursor);
+	char const *name = strlen(buf->filename) ? buf->filename : "[new]";
+	char str[STATUS_MAX];
+	int n;
+
+	// binary text could have few newlines, lines aren't counted for it
+	if (buf->hex) {
+		n = snprintf(str, sizeof(str), " %s  @%zu (0x%zx)  %zu bytes",
+		             name, off, off, len);
+	} else if (!lindex_ready(buf)) {
+		n = snprintf(str, sizeof(str),
+		             " %s  --:--  counting...  %zu bytes", name, len);
+	} else {
+		size_t line, col;
+		lindex_pos(buf, off, &line, &col);
+
+		size_t lines = buf->lidx ? buf->lidx->lines : 0;
+		if (!len || *off_to_ptr(buf, len - 1) != '\n')
+			lines++;
+
+		n = snprintf(str, sizeof(str),
+		             " %s  %zu:%zu  %zu lines  %zu bytes%s%s",
+		             name, line + 1, col + 1, lines, len,
+		             buf->eol == EOL_CRLF ? "  CRLF" : "",
+		             buf->strip_ws ? "  strip" : "");
+	}
+	if (buf->sel && n > 0 && (size_t)n < sizeof(str)) {
+		size_t sel = ptr_to_off(buf, buf->sel);
+		snprintf(str + n, sizeof(str) - n, "  %zu selected",
+		         sel > off ? sel - off : off - sel);
+	}
+
+	wattroff(win, A_UNDERLINE);
+	wattron(win, A_REVERSE);
+	wmove(win, row, 0);
+	for (int i = 0; i < cols; i++)
+		waddch(win, ' ');
+	mvwaddnstr(win, row, 0, str, cols);
+	wattroff(win, A_REVERSE);
+}
@@ -1,9 +1,29 @@
-#ifndef DISPLAY_H 
-#define DISPLAY_H 
+#ifndef DISPLAY_H
+#define DISPLAY_H
 #include "buffer.h"
-#define LINESONPAGE LINES/2
 
-// displays (some) of  the buffer content on screen
-int display(struct buffer *buf);
+#include <ncurses.h>
+
+#define STATUS_MAX 256
+#define HEX_ROW_MAX 16       // bytes in a row of hex view
+
+// what was drawn in a window, so next time only rows that were changed
+// are drawn. Zeroed state makes the window drawn whole
+struct disp_state {
+	struct buffer const *buf;
+	size_t top;           // offset of first displayed byte
+	size_t changes;       // buf->changes when text was drawn
+	int rows;             // text rows, last row of window is status line
+	int cols;
+	int plain;            // there was no selection, additional cursors
+	                      // or matching bracket
+};
+
+// displays (some) of the buffer content and its status line in window,
+// window cursor is moved to buffer cursor. Terminal isn't updated
+int display(struct buffer *buf, WINDOW *win, struct disp_state *st);
+
+// bytes in a row of hex view in window of cols columns
+int hex_row_bytes(struct buffer const *buf, int cols);
 
 #endif /* DISPLAY_H */
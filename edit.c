@@ -1,25 +1,159 @@
 #include "buffer.h"
 #include "display.h"
 #include "edit.h"
+#include "filter.h"
+#include "follow.h"
+#include "journal.h"
+#include "kring.h"
+#include "lindex.h"
+#include "mark.h"
+#include "mcursor.h"
+#include "nest.h"
 #include "operation.h"
+#include "stream.h"
 #include "slog.h"
 #include "rc.h"
+#include "search.h"
+#include "term.h"
 #include "util.h"
 #include "utf.h"
+#include "window.h"
+#include "words.h"
 
-#include <locale.h>
 #include <ncurses.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #define ALT_BACKSPACE 127 
 #define KEY_ESC 27
+#define KEY_FOCUS_IN (KEY_MAX + 1)
+#define KEY_FOCUS_OUT (KEY_MAX + 2)
+#define KEY_TAKEN (KEY_MAX + 3)     // key was handled by hex view
+#define COMPL_MAX 16        // completions offered for a word
+#define FRAME_MS 16         // shortest time between two redraws
+#define SEARCH_WAIT_MS 10   // how often search is checked for next match
+#define MACRO_MAX 4096      // keys of macro, the rest isn't recorded
+#define MACRO_CHECK_MS 100  // how often replay shows progress
+
+// what edit_run does after a key
+#define DO_DRAW 0           // screen is drawn
+#define DO_KEEP 1           // screen is left as it is, e.g. with message
+#define DO_QUIT 2
+#define DO_FAIL 3
+
+// redraw that is put off until frame time comes
+struct frame {
+	bool dirty;
+	struct timespec drawn;  // when last frame was drawn
+	struct timespec since;  // when first change after it was made
+	long max_wait_ms;       // longest time from change to frame
+	unsigned long keys;
+	unsigned long frames;
+};
+
+// file given to the editor, its buffer is made when it's shown first
+// time, so files that weren't looked at take no memory
+struct file_node {
+	char name[FNAMELEN_MAX];
+	struct buffer *buf;     // NULL until file is shown
+};
+
+static struct file_node *files;
+static size_t files_num;
+
+// last paste, it could be changed to older kill ring entry while text
+// wasn't changed after it
+struct yank {
+	struct buffer *buf;     // NULL if there was no such paste
+	size_t off;
+	size_t len;
+	size_t k;               // kill ring entry that was pasted
+	size_t changes;         // buf->changes after paste
+};
+
+static struct yank yank;
+
+// last completion, it could be changed to the next one while text wasn't
+// changed after it. Only the rest of the word after prefix is inserted
+struct compl {
+	struct buffer *buf;     // NULL if there was no such completion
+	size_t off;
+	size_t len;
+	size_t k;               // word that was inserted, num for none
+	size_t num;
+	size_t prefix_len;
+	size_t changes;         // buf->changes after completion
+	char words[COMPL_MAX][WORD_MAX + 1];
+};
+
+static struct compl compl;
+
+// hex digit typed in hex view sets high half of byte, the next one typed
+// right after it sets the low half and moves cursor on
+struct nibble {
+	struct buffer *buf;     // NULL if the next digit is high half
+	size_t off;
+	size_t changes;         // buf->changes after high half
+};
+
+static struct nibble nibble;
+
+// keys recorded from the user, they're replayed by do_key in a loop
+// without drawing the screen
+struct macro {
+	int keys[MACRO_MAX];
+	size_t num;
+	size_t pos;             // next key while it's played
+	bool recording;
+	bool playing;
+};
+
+static struct macro macro;
+
+// shown at start and on F1
+static char const *help_str = "F1-Help  F2-Save   F3-Sel(on/off)  "
+                              "F4-Copy  F5-Cut  F6-Paste  ^Y-Older paste  "
+                              "F7-Follow  "
+                              "F8-Cursor at match  F9-Cursor on lines  "
+                              "F10-Quit  F11-Go to  F12-Next file  "
+                              "^T-Split  ^O-Other window  ^W-Close window  "
+                              "^P-Pipe through command  "
+                              "^F-Find all  ^N-Next match  ^R-Previous match  "
+                              "^K-Complete word  ^B-Matching bracket  "
+                              "^X-Hex view  ^E-LF/CRLF  "
+                              "^G-Strip trailing spaces on save  "
+                              "^L-Record macro  ^U-Run macro  "
+                              "(any key - to continue)";
+
+// last find all, cursor goes to the next match as soon as it's known
+static struct search *found;
+static struct buffer *found_buf;
+static bool found_jump;
+static bool found_prev;
+static size_t found_off;    // jump is to match from (before) it
+
+// message shown while last key was handled, it's shown again if the
+// screen is redrawn under it
+static char last_msg[COLS_MAX];
+static bool last_msg_status;
 
-static void get_input(char * prompt, char *input, size_t size);
 static void msg(char const * msg);
+static void status_msg(char const * msg);
 static int save_to_file(struct buffer *buf);
 static void cut_selection(struct buffer *buf);
 static int paste_selection(struct buffer *buf);
+static bool can_yank(struct buffer const *buf);
+static int yank_older(struct buffer *buf);
+static bool complete(struct buffer *buf);
+static bool jump_bracket(struct buffer *buf);
+static bool hex_key(struct buffer *buf, int ch);
+static void hex_put(struct buffer *buf, int digit);
+static void toggle_hex(struct buffer *buf);
+static bool toggle_eol(struct buffer *buf);
+static bool toggle_strip(struct buffer *buf);
 static void copy_selection(struct buffer *buf);
 static void delete(struct buffer *buf);
 static void delete_prev(struct buffer *buf);
@@ -33,44 +167,92 @@ static void end(struct buffer *buf);
 static int add_symbol(struct buffer *buf, char ch);
 
 static int term_init(void); 
+static void recover(struct buffer *buf);
+static void toggle_follow(struct buffer *buf);
+static bool follow_tick(struct buffer *buf);
+static bool check_file(struct buffer *buf);
+static int reload(struct buffer *buf);
+static int input_timeout(struct buffer const *buf);
+static bool stream_tick(struct buffer *buf);
+static bool count_tick(struct buffer *buf);
+static bool multi(struct buffer const *buf);
+static void go_to(struct buffer *buf);
+static bool pipe_through(struct buffer *buf);
+static bool find_all(struct buffer *buf);
+static bool find_step(struct buffer *buf, bool prev);
+static bool find_tick(void);
+static void find_stop(void);
+static void show_match(struct buffer *buf, size_t off);
+static int add_file(char const *fname, struct buffer *buf);
+static struct buffer * open_file(char const *fname);
+static void next_file(void);
+static bool tick_all(void);
+static int timeout_all(void);
+static void render(struct buffer *buf, struct frame *fr);
+static int do_key(struct buffer **pbuf, int ch);
+static int read_key(void);
+static bool recordable(int ch);
+static bool toggle_record(void);
+static int run_macro(struct buffer *buf);
+static bool play(struct buffer *buf);
+static int frame_wait(struct frame const *fr, int wait);
+static long ms_since(struct timespec const *t);
 
 struct buffer * edit_prepare(char const *fname)
 {
+	int in_fd = -1;
+	if (fname && !strcmp(fname, STDIN_FNAME)) {
+		in_fd = stream_take_stdin();
+		if (in_fd < 0) {
+			log_ss("error", "stream_take_stdin fail");
+			return NULL;
+		}
+		fname = NULL;
+	}
+
 	if (term_init() != SUCCESS) {
 		log_ss("error", "term_init fail");
 		return NULL;
 	}
 
-	struct buffer *buf = create_buffer();
+	struct buffer *buf = fname ? open_file(fname) : create_buffer();
 	if (!buf) {
-		log_ss("error", "create_buffer fail");
-		msg("Error. Details in " LOGFILE);
-		getch();
+		log_ss("error", "edit_prepare buffer fail");
+		if (!fname) {
+			msg("Error. Details in " LOGFILE);
+			getch();
+		}
 		return NULL;
 	}
 
-	if (fname) {
-		if (file_exists(fname)) {
-			if (load_file(buf, fname) == ERROR) {
-				log_ss("error", "load_file fail");
-				msg("Error. Details in " LOGFILE);
-				getch();
-				return NULL; 
-			}
-		} else {
-			strncpy(buf->filename, fname, FNAMELEN_MAX);
+	if (add_file(fname, buf) != SUCCESS) {
+		log_ss("error", "add_file fail");
+		delete_buffer(buf);
+		return NULL;
+	}
+
+	if (in_fd >= 0) {
+		if (stream_start(buf, in_fd) != SUCCESS) {
+			log_ss("error", "stream_start fail");
+			close(in_fd);
 		}
+		stream_tick(buf);
 	}
 
 	return buf;
 }
 
+int edit_add(char const *fname)
+{
+	return add_file(fname, NULL);
+}
+
 int edit_run(struct buffer *buf)
 {
 	if (!buf)
 		return ERROR;
 
-	if (display(buf) != SUCCESS) {
+	if (win_start(buf) != SUCCESS || win_draw() != SUCCESS) {
 		log_ss("error", "edit_run display fail");
 		msg("Error. Details in " LOGFILE);
 		getch();
@@ -78,91 +260,45 @@ int edit_run(struct buffer *buf)
 	}
 
 	move(0, 0);
-	char const *help_str = "F1-Help  F2-Save   F3-Sel(on/off)  "
-	                       "F4-Copy  F5-Cut  F6-Paste  F10-Quit  "
-	                       "(any key - to continue)";
 	msg(help_str);
 
 	int ch;
 	bool in_loop = true;
 	bool err = false;
+	struct frame fr = {0};
     	while(in_loop) {
-    		bool redisplay = true;
+		if (fr.dirty && ms_since(&fr.drawn) >= FRAME_MS)
+			render(buf, &fr);
+
+		timeout(frame_wait(&fr, timeout_all()));
+		ch = read_key();
+		if (ch != ERR)
+			fr.keys++;
+		last_msg[0] = '\0';
 
-		switch(ch = getch()) {
-		case KEY_F(10):
+		int rc = do_key(&buf, ch);
+		if (rc == DO_QUIT || rc == DO_FAIL) {
 			in_loop = false;
-			break;
-    		case KEY_RIGHT:
-			mv_cursor(buf, DIR_NEXT);
-			break;
-		case KEY_LEFT:
-			mv_cursor(buf, DIR_PREV);
-			break;
-		case KEY_DOWN:
-			mv_cursor(buf, DIR_LINENEXT);
-			break;
-		case KEY_UP:
-			mv_cursor(buf, DIR_LINEPREV);
-			break;
-		case KEY_BACKSPACE:
-		case ALT_BACKSPACE:
-			delete_prev(buf);
-			break;
-		case KEY_DC:
-    			delete(buf);
-    			break;
-    		case KEY_ESC:
-    			buf->sel =  NULL;
-    			break;
-    		case KEY_F(1):
-			msg(help_str);
-			redisplay = 0;
-			break;
-		case KEY_F(2):
-			save_to_file(buf);
-			redisplay = 0;
-			break;
-		case KEY_F(3):
-			toggle_selection(buf);
-			break;
-		case KEY_F(4):
-			copy_selection(buf);
-			break;
-		case KEY_F(5):
-			cut_selection(buf);
-			break;
-		case KEY_F(6):
-			if (paste_selection(buf) == ERROR) {
-				log_ss("error", "paste_selection fail");
-				in_loop = false;
-				err = true;
-			}
-			break;
-		case KEY_NPAGE:
-			pg_down(buf);
-			break;
-		case KEY_PPAGE:
-			pg_up(buf);
-			break;
-		case KEY_HOME:
-			home(buf);
-			break;
-		case KEY_END:
-			end(buf);
-			break;
-		default:
-			if (add_symbol(buf, ch) == ERROR) {
-				log_ss("error", "add_symbol fail");
-				in_loop = false;
-				err = true;
-				continue;
-			}
+			err = (rc == DO_FAIL);
+			continue;
+		}
+		mc_check(buf);
+		bool redisplay = (rc == DO_DRAW);
+		if (redisplay && !fr.dirty) {
+			fr.dirty = true;
+			clock_gettime(CLOCK_MONOTONIC, &fr.since);
+		} else if (!redisplay && fr.dirty && last_msg[0]) {
+			render(buf, &fr);
+			if (last_msg_status)
+				status_msg(last_msg);
+			else
+				msg(last_msg);
 		}
-
-		if (redisplay)
-			display(buf);
     	}
+
+	log_si("edit_run keys", (int)fr.keys);
+	log_si("edit_run frames", (int)fr.frames);
+	log_si("edit_run max frame wait ms", (int)fr.max_wait_ms);
 	
 	if (err) {
 		msg("Error. Details in " LOGFILE);
@@ -173,49 +309,600 @@ int edit_run(struct buffer *buf)
 	return SUCCESS;
 }
 
+/*
+ * Key is applied to buffer of the active window, which could change.
+ * Returns what edit_run should do next
+ */
+static int do_key(struct buffer **pbuf, int ch)
+{
+	struct buffer *buf = *pbuf;
+	bool redisplay = true;
+
+	mc_check(buf);
+	if (buf->hex && hex_key(buf, ch))
+		ch = KEY_TAKEN;
+
+	switch(ch) {
+	case ERR:
+		redisplay = tick_all();
+		break;
+	case KEY_FOCUS_IN:
+		redisplay = check_file(buf);
+		break;
+	case KEY_FOCUS_OUT:
+		redisplay = false;
+		break;
+	case KEY_TAKEN:
+		break;
+	case KEY_F(10):
+		return DO_QUIT;
+	case KEY_RIGHT:
+		mv_cursor(buf, DIR_NEXT);
+		break;
+	case KEY_LEFT:
+		mv_cursor(buf, DIR_PREV);
+		break;
+	case KEY_DOWN:
+		mv_cursor(buf, DIR_LINENEXT);
+		break;
+	case KEY_UP:
+		mv_cursor(buf, DIR_LINEPREV);
+		break;
+	case KEY_BACKSPACE:
+	case ALT_BACKSPACE:
+		delete_prev(buf);
+		break;
+	case KEY_DC:
+		delete(buf);
+		break;
+	case KEY_ESC:
+		buf->sel = NULL;
+		mc_clear(buf);
+		break;
+	case KEY_F(1):
+		msg(help_str);
+		redisplay = 0;
+		break;
+	case KEY_F(2):
+		save_to_file(buf);
+		redisplay = 0;
+		break;
+	case KEY_F(3):
+		toggle_selection(buf);
+		break;
+	case KEY_F(4):
+		copy_selection(buf);
+		break;
+	case KEY_F(5):
+		cut_selection(buf);
+		break;
+	case KEY_F(6):
+		if (paste_selection(buf) == ERROR) {
+			log_ss("error", "paste_selection fail");
+			return DO_FAIL;
+		}
+		break;
+	case KEY_CTRL('y'):
+		if (!can_yank(buf)) {
+			msg("Paste text with F6 first");
+			redisplay = false;
+		} else if (yank_older(buf) == ERROR) {
+			log_ss("error", "yank_older fail");
+			return DO_FAIL;
+		}
+		break;
+	case KEY_CTRL('k'):
+		redisplay = complete(buf);
+		break;
+	case KEY_CTRL('b'):
+		redisplay = jump_bracket(buf);
+		break;
+	case KEY_CTRL('x'):
+		toggle_hex(buf);
+		break;
+	case KEY_CTRL('e'):
+		redisplay = toggle_eol(buf);
+		break;
+	case KEY_CTRL('g'):
+		redisplay = toggle_strip(buf);
+		break;
+	case KEY_CTRL('l'):
+		redisplay = toggle_record();
+		break;
+	case KEY_CTRL('u'):
+		return run_macro(buf);
+	case KEY_F(7):
+		toggle_follow(buf);
+		break;
+	case KEY_F(8):
+		if (mc_add_next_match(buf) != SUCCESS)
+			msg("Select text to find, no more matches");
+		break;
+	case KEY_F(9):
+		if (mc_add_sel_lines(buf) != SUCCESS)
+			msg("Select lines to add cursors to");
+		break;
+	case KEY_F(11):
+		go_to(buf);
+		break;
+	case KEY_CTRL('p'):
+		if (!pipe_through(buf))
+			redisplay = false;
+		break;
+	case KEY_CTRL('f'):
+		redisplay = find_all(buf);
+		break;
+	case KEY_CTRL('n'):
+		redisplay = find_step(buf, false);
+		break;
+	case KEY_CTRL('r'):
+		redisplay = find_step(buf, true);
+		break;
+	case KEY_F(12):
+		next_file();
+		buf = win_buf();
+		*pbuf = buf;
+		break;
+	case KEY_CTRL('t'):
+		if (win_split() != SUCCESS) {
+			msg("No room for one more window");
+			redisplay = false;
+		}
+		break;
+	case KEY_CTRL('o'):
+		mc_clear(buf);
+		win_other();
+		buf = win_buf();
+		*pbuf = buf;
+		break;
+	case KEY_CTRL('w'):
+		mc_clear(buf);
+		win_close();
+		buf = win_buf();
+		*pbuf = buf;
+		break;
+	case KEY_RESIZE:
+		win_resize();
+		break;
+	case KEY_NPAGE:
+		pg_down(buf);
+		break;
+	case KEY_PPAGE:
+		pg_up(buf);
+		break;
+	case KEY_HOME:
+		home(buf);
+		break;
+	case KEY_END:
+		end(buf);
+		break;
+	default:
+		if (add_symbol(buf, ch) == ERROR) {
+			log_ss("error", "add_symbol fail");
+			return DO_FAIL;
+		}
+	}
+
+	return redisplay ? DO_DRAW : DO_KEEP;
+}
+
+// key from the user or from macro that is played, keys from the user are
+// recorded while macro is recorded
+static int read_key(void)
+{
+	if (macro.playing)
+		return macro.pos < macro.num ? macro.keys[macro.pos++] : ERR;
+
+	int ch = getch();
+	if (macro.recording && macro.num < MACRO_MAX && recordable(ch))
+		macro.keys[macro.num++] = ch;
+	return ch;
+}
+
+// keys that edit text and move cursor. Others ask for input, draw the
+// screen, move by what was drawn or change the window
+static bool recordable(int ch)
+{
+	switch (ch) {
+	case KEY_RIGHT:
+	case KEY_LEFT:
+	case KEY_DOWN:
+	case KEY_UP:
+	case KEY_HOME:
+	case KEY_END:
+	case KEY_BACKSPACE:
+	case ALT_BACKSPACE:
+	case KEY_DC:
+	case KEY_ESC:
+	case KEY_F(3):
+	case KEY_F(4):
+	case KEY_F(5):
+	case KEY_F(6):
+	case KEY_F(8):
+	case KEY_F(9):
+	case KEY_CTRL('y'):
+	case '\n':
+	case '\t':
+		return true;
+	}
+	return ch >= ' ' && ch <= 0xff;
+}
+
+static bool toggle_record(void)
+{
+	char str[COLS_MAX];
+	macro.recording = !macro.recording;
+	if (macro.recording) {
+		macro.num = 0;
+		snprintf(str, sizeof(str), "Recording macro, ^L to stop");
+	} else {
+		snprintf(str, sizeof(str), "Macro of %zu keys, ^U to run it",
+		         macro.num);
+	}
+
+	win_draw();
+	status_msg(str);
+	return false;
+}
+
+/*
+ * Macro is run N times, or once from begin of each selected line. Keys
+ * go to do_key in a loop and the screen is drawn once at the end,
+ * progress is shown and any key stops the run every MACRO_CHECK_MS.
+ * Lines are followed by marks, so the macro could add or delete lines.
+ */
+static int run_macro(struct buffer *buf)
+{
+	if (macro.recording || !macro.num) {
+		msg(macro.recording ? "Stop recording with ^L first"
+		                    : "No macro, record it with ^L");
+		return DO_KEEP;
+	}
+
+	char str[COLS_MAX] = "";
+	get_input("Run macro N times (empty - on each selected line): ",
+	          str, sizeof(str) - 1);
+	bool lines = !str[0] && buf->sel;
+	size_t times = str[0] ? strtoull(str, NULL, 10) : 1;
+
+	struct mark *next = NULL;
+	struct mark *last = NULL;
+	if (lines) {
+		char *b = buf->sel < buf->cursor ? buf->sel : buf->cursor;
+		char *e = buf->sel < buf->cursor ? buf->cursor : buf->sel;
+		b = ptr_to_line_b(buf, b);
+		e = ptr_to_line_b(buf, e);
+		next = mark_new(buf->marks, ptr_to_off(buf, b));
+		last = mark_new(buf->marks, ptr_to_off(buf, e));
+		if (!next || !last) {
+			mark_free(buf->marks, next);
+			mark_free(buf->marks, last);
+			log_ss("error", "run_macro mark_new fail");
+			return DO_FAIL;
+		}
+		buf->sel = NULL;
+	}
+
+	struct timespec checked;
+	clock_gettime(CLOCK_MONOTONIC, &checked);
+	size_t done = 0;
+	bool ok = true;
+	bool stopped = false;
+	while (ok && !stopped && (lines || done < times)) {
+		if (lines) {
+			size_t cur = mark_off(next);
+			if (cur > mark_off(last))
+				break;
+			long nl = find_bytes(buf, cur, "\n", 1);
+			size_t to = nl < 0 ? buf_len(buf) : (size_t)nl + 1;
+			mark_move(buf->marks, next, to);
+			buf->cursor = off_to_ptr(buf, cur);
+			ok = play(buf);
+			if (nl < 0)
+				lines = false;
+		} else {
+			ok = play(buf);
+		}
+		done++;
+
+		if (ms_since(&checked) >= MACRO_CHECK_MS) {
+			snprintf(str, sizeof(str),
+			         "Macro run %zu times (any key - stop)", done);
+			status_msg(str);
+			nodelay(stdscr, TRUE);
+			stopped = (getch() != ERR);
+			nodelay(stdscr, FALSE);
+			clock_gettime(CLOCK_MONOTONIC, &checked);
+		}
+	}
+
+	if (next) {
+		mark_free(buf->marks, next);
+		mark_free(buf->marks, last);
+	}
+	if (!ok)
+		return DO_FAIL;
+
+	// view is moved to cursor only if it went off screen
+	win_draw();
+	if (buf->cursor < buf->disp_b || buf->cursor > buf->disp_e) {
+		char *p = buf->cursor;
+		edit_goto(buf, line_num(buf, p) + 1, col_num(buf, p) + 1);
+		win_draw();
+	}
+	snprintf(str, sizeof(str), "Macro run %zu times%s", done,
+	         stopped ? ", stopped" : "");
+	status_msg(str);
+	return DO_KEEP;
+}
+
+// all keys of macro, false if one of them failed
+static bool play(struct buffer *buf)
+{
+	macro.playing = true;
+	macro.pos = 0;
+	int rc = DO_DRAW;
+	while (macro.pos < macro.num && rc != DO_FAIL)
+		rc = do_key(&buf, read_key());
+	macro.playing = false;
+	return rc != DO_FAIL;
+}
+
+void edit_goto(struct buffer *buf, size_t line, int col)
+{
+	if (line)
+		line--;
+	if (col)
+		col--;
+
+	size_t half = win_rows() / 2;
+	size_t top_line = line > half ? line - half : 0;
+	mv_to_line(buf, line, col, top_line);
+}
+
+/*
+ * Input is applied as it comes, but screen is drawn at most once for
+ * FRAME_MS, so keys that repeat faster than that don't pile up frames.
+ */
+static void render(struct buffer *buf, struct frame *fr)
+{
+	win_draw();
+	if (buf->stream) {
+		char str[COLS_MAX];
+		snprintf(str, sizeof(str), "Reading stdin: %zu bytes",
+		         buf->stream->bytes);
+		status_msg(str);
+	}
+
+	long waited = ms_since(&fr->since);
+	if (waited > fr->max_wait_ms)
+		fr->max_wait_ms = waited;
+	clock_gettime(CLOCK_MONOTONIC, &fr->drawn);
+	fr->dirty = false;
+	fr->frames++;
+}
+
+// input timeout that wakes up when pending frame should be drawn
+static int frame_wait(struct frame const *fr, int wait)
+{
+	if (!fr->dirty)
+		return wait;
+
+	long left = FRAME_MS - ms_since(&fr->drawn);
+	if (left < 0)
+		left = 0;
+	return (wait < 0 || left < wait) ? (int)left : wait;
+}
+
+static long ms_since(struct timespec const *t)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1000
+	       + (now.tv_nsec - t->tv_nsec) / 1000000;
+}
+
 int edit_end(struct buffer *buf)
 {
+	// disable focus events
+	printf("\033[?1004l");
+	fflush(stdout);
         endwin();
-	if (buf) { 
-		delete_buffer(buf);
-		return SUCCESS;
-	} 
+	win_end();
+	find_stop();
+
+	for (size_t i = 0; i < files_num; i++) {
+		struct buffer *b = files[i].buf;
+		if (!b)
+			continue;
+		stream_stop(b);
+		mc_clear(b);
+		follow_stop(b);
+		journal_close(b, 1);
+		delete_buffer(b);
+	}
+	free(files);
+	files = NULL;
+	files_num = 0;
+	kring_free();
 
-	return ERROR;
+	return (buf ? SUCCESS : ERROR);
 }
 
 static int term_init(void)
 {
-	setlocale(LC_ALL, "");
-        initscr();
-	cbreak();
-	keypad(stdscr, TRUE);
-	noecho();
-	set_escdelay(20);
+	term_setup();
+	idlok(stdscr, TRUE);  // display scrolls text rows with scroll region
+
+	// ask terminal to report focus events
+	define_key("\033[I", KEY_FOCUS_IN);
+	define_key("\033[O", KEY_FOCUS_OUT);
+	printf("\033[?1004h");
+	fflush(stdout);
 
 	return SUCCESS;
 }
 
-static void get_input(char * prompt, char *input, size_t size)
+// replay journal left by crashed session and start journaling
+static void recover(struct buffer *buf)
+{
+	int keep = 0;
+	if (journal_exists(buf->filename)) {
+		msg("Found unsaved changes. Recover them? (y/n)");
+		if (getch() == 'y') {
+			keep = (journal_replay(buf) == SUCCESS);
+			if (!keep) {
+				msg("Error. Details in " LOGFILE);
+				getch();
+			}
+		}
+	}
+
+	if (journal_open(buf, keep) != SUCCESS)
+		log_ss("error", "journal_open fail");
+}
+
+static void toggle_follow(struct buffer *buf)
+{
+	if (buf->follow) {
+		follow_stop(buf);
+		return;
+	}
+
+	if (follow_start(buf) != SUCCESS) {
+		log_ss("error", "follow_start fail");
+		return;
+	}
+	mv_to_end(buf, win_rows());
+	follow_tick(buf);
+}
+
+// append new bytes of followed file, keep last lines on screen if
+// cursor was at the end of text. returns true if buffer was changed
+static bool follow_tick(struct buffer *buf)
+{
+	bool pinned = (ptr_to_off(buf, buf->cursor) == buf_len(buf));
+
+	long bytes = follow_update(buf);
+	if (bytes < 0) {
+		follow_stop(buf);
+		win_draw();
+		msg("File was truncated or changed. Follow mode off");
+		return false;
+	}
+
+	if (bytes && pinned)
+		mv_to_end(buf, win_rows());
+
+	return (bytes > 0);
+}
+
+// offer reload if file was changed on disk by other process.
+// returns true if buffer was reloaded
+static bool check_file(struct buffer *buf)
+{
+	if (buf->follow || file_changed(buf) == FILE_SAME)
+		return false;
+
+	msg("File was changed on disk. Reload it? (y/n)");
+	if (getch() != 'y') {
+		win_draw();
+		return false;
+	}
+
+	if (reload(buf) != SUCCESS) {
+		log_ss("error", "reload fail");
+		msg("Error. Details in " LOGFILE);
+		return false;
+	}
+
+	return true;
+}
+
+// reload file keeping cursor and screen at the same lines
+static int reload(struct buffer *buf)
 {
-	attron(A_REVERSE);
-	echo();
-	move(LINES - 1, 0);         
-	for (int i = 0; i < COLS; i++) {
-		addch(' ');
+	size_t line = line_num(buf, buf->cursor);
+	size_t top_line = line_num(buf, buf->disp_b);
+	int col = col_num(buf, buf->cursor);
+	bool appended = (file_changed(buf) == FILE_APPENDED);
+
+	if (reload_file(buf) != SUCCESS) {
+		if (!appended)
+			return ERROR;
+		// line ends of appended part differ from the loaded ones
+		appended = false;
+		if (reread_file(buf) != SUCCESS)
+			return ERROR;
 	}
-	mvaddnstr(LINES - 1, 0, prompt, COLS);
-	getnstr(input, size);
-	noecho();
-	attroff(A_REVERSE);
+
+	// records of unsaved edits still apply to the file grown at its end
+	if (appended)
+		return journal_rehead(buf);
+
+	mv_to_line(buf, line, col, top_line);
+	return journal_reset(buf);
+}
+
+// how long to wait for key before reading background input
+static int input_timeout(struct buffer const *buf)
+{
+	if (buf->stream)
+		return buf->stream->more ? 0 : STREAM_POLL_MS;
+	if (buf->follow)
+		return FOLLOW_POLL_MS;
+	if (buf->lidx && buf->lidx->building)
+		return LINDEX_POLL_MS;
+	return -1;
+}
+
+// true when background line counting has just finished, status shows
+// the cursor line from then
+static bool count_tick(struct buffer *buf)
+{
+	if (!buf->lidx || !buf->lidx->building)
+		return false;
+	return lindex_ready(buf);
+}
+
+// read next part of stdin, returns true if buffer was changed
+static bool stream_tick(struct buffer *buf)
+{
+	if (!buf->stream)
+		return false;
+
+	long bytes = stream_update(buf);
+	if (bytes >= 0)
+		return (bytes > 0);
+
+	char str[COLS_MAX];
+	snprintf(str, sizeof(str), "%zu bytes read from stdin",
+	         buf->stream->bytes);
+	stream_stop(buf);
+	win_draw();
+	status_msg(str);
+	return false;
 }
 
 static int save_to_file(struct buffer *buf)
 {
 	while (!strlen(buf->filename))
 		get_input("Enter filename: ", buf->filename, FNAMELEN_MAX);
+
+	if (file_changed(buf) != FILE_SAME) {
+		msg("File was changed on disk. Overwrite it? (y/n)");
+		if (getch() != 'y') {
+			msg("File wasn't saved");
+			return ERROR;
+		}
+	}
 	
 	if (save(buf) == SUCCESS) {
+		update_finfo(buf, get_fsize(buf->filename));
+		if (buf->jnl)
+			journal_reset(buf);
+		else
+			journal_open(buf, 0);
 		msg("File saved");
 		return SUCCESS;
 	} else {
@@ -226,17 +913,25 @@ static int save_to_file(struct buffer *buf)
 
 static void msg(char const * msg)
 {
-	attron(A_REVERSE);
-	echo();
-	move(LINES - 1, 0);         
-	for (int i = 0; i < COLS; i++) {
-		addch(' ');
-	}
-	move(LINES - 1, 0);         
-	addnstr(msg, COLS);
+	if (msg != last_msg)
+		snprintf(last_msg, sizeof(last_msg), "%s", msg);
+	last_msg_status = false;
+
+	term_status(msg);
 	move(LINES - 1, COLS - 1);
-	noecho();
-	attroff(A_REVERSE);
+}
+
+// like msg, but cursor is left in the text
+static void status_msg(char const * msg)
+{
+	if (msg != last_msg)
+		snprintf(last_msg, sizeof(last_msg), "%s", msg);
+	last_msg_status = true;
+
+	int y, x;
+	getyx(stdscr, y, x);
+	term_status(msg);
+	move(y, x);
 }
 
 static void cut_selection(struct buffer *buf)
@@ -251,13 +946,255 @@ static void cut_selection(struct buffer *buf)
 static int paste_selection(struct buffer *buf)
 {
 	bool ok = true;
-	if (buf->copy_buf && buf->copy_buf_size) {
-		ok = (paste(buf) == SUCCESS);
+	size_t len;
+	char const *src = kring_get(0, &len);
+	yank.buf = NULL;
+
+	if (src) {
+		if (multi(buf)) {
+			ok = (mc_insert(buf, src, len) == SUCCESS);
+		} else {
+			size_t off = ptr_to_off(buf, buf->cursor);
+			ok = (paste(buf, 0, &len) == SUCCESS);
+			if (ok)
+				yank = (struct yank){buf, off, len, 0,
+				                     buf->changes};
+		}
 		buf->sel = NULL;
 	}
 	return (ok ? SUCCESS : ERROR);
 }
 
+static bool can_yank(struct buffer const *buf)
+{
+	return yank.buf == buf && yank.changes == buf->changes
+	       && !multi(buf);
+}
+
+// pasted text is replaced by the next older kill ring entry, after the
+// oldest one the newest comes again
+static int yank_older(struct buffer *buf)
+{
+	delete_bytes(buf, yank.off, yank.len);
+	yank.k = (yank.k + 1) % kring_num();
+	yank.buf = NULL;
+
+	size_t len;
+	if (paste(buf, yank.k, &len) != SUCCESS)
+		return ERROR;
+
+	yank.buf = buf;
+	yank.len = len;
+	yank.changes = buf->changes;
+	return SUCCESS;
+}
+
+/*
+ * Words are looked up once for the word before cursor, then each press
+ * puts the next one in place of the previous, the last one is followed
+ * by the typed prefix alone.
+ */
+static bool complete(struct buffer *buf)
+{
+	if (multi(buf)) {
+		msg("Completion is for one cursor");
+		return false;
+	}
+
+	if (compl.buf == buf && compl.changes == buf->changes) {
+		delete_bytes(buf, compl.off, compl.len);
+		compl.k = (compl.k + 1) % (compl.num + 1);
+	} else {
+		size_t off = ptr_to_off(buf, buf->cursor);
+		size_t b = off;
+		while (b && off - b < WORD_MAX &&
+		       word_ch(*off_to_ptr(buf, b - 1)))
+			b--;
+
+		char prefix[WORD_MAX];
+		for (size_t i = b; i < off; i++)
+			prefix[i - b] = *off_to_ptr(buf, i);
+
+		compl.buf = NULL;
+		compl.num = words_complete(buf, prefix, off - b, compl.words,
+		                           COMPL_MAX);
+		if (!compl.num) {
+			msg(buf->words ? "No completions" : "No word index");
+			return false;
+		}
+		compl.off = off;
+		compl.k = 0;
+		compl.prefix_len = off - b;
+	}
+
+	compl.len = 0;
+	if (compl.k < compl.num) {
+		char const *rest = compl.words[compl.k] + compl.prefix_len;
+		compl.len = strlen(rest);
+		if (insert_bytes(buf, compl.off, rest, compl.len) != SUCCESS) {
+			log_ss("error", "complete insert_bytes fail");
+			compl.buf = NULL;
+			return true;
+		}
+	}
+	compl.buf = buf;
+	compl.changes = buf->changes;
+
+	char str[COLS_MAX];
+	if (compl.k < compl.num)
+		snprintf(str, sizeof(str), "Completion %zu of %zu",
+		         compl.k + 1, compl.num);
+	else
+		snprintf(str, sizeof(str), "No completion, ^K for the first");
+	win_draw();
+	status_msg(str);
+	return false;
+}
+
+// view is moved only if the match isn't on screen
+static bool jump_bracket(struct buffer *buf)
+{
+	long m = nest_match(buf, ptr_to_off(buf, buf->cursor));
+	if (m < 0) {
+		msg("No matching bracket at cursor");
+		return false;
+	}
+
+	char *p = off_to_ptr(buf, m);
+	if (p >= buf->disp_b && buf->disp_e && p < buf->disp_e)
+		buf->cursor = p;
+	else
+		edit_goto(buf, line_num(buf, p) + 1, col_num(buf, p) + 1);
+	return true;
+}
+
+/*
+ * Cursor moves by bytes and rows of hex view, paging moves the view
+ * too. Printable keys don't insert text there, hex digits overwrite the
+ * byte at cursor. Other keys are left for the usual handling.
+ */
+static bool hex_key(struct buffer *buf, int ch)
+{
+	size_t len = buf_len(buf);
+	size_t off = ptr_to_off(buf, buf->cursor);
+	size_t top = ptr_to_off(buf, buf->disp_b);
+	size_t n = hex_row_bytes(buf, win_cols());
+	size_t page = n * win_rows();
+	size_t to = off;
+
+	switch (ch) {
+	case KEY_RIGHT:
+		to = off < len ? off + 1 : off;
+		break;
+	case KEY_LEFT:
+		to = off ? off - 1 : 0;
+		break;
+	case KEY_DOWN:
+		to = off + n <= len ? off + n : len;
+		break;
+	case KEY_UP:
+		to = off >= n ? off - n : off;
+		break;
+	case KEY_NPAGE:
+		to = off + page <= len ? off + page : len;
+		if (top + page <= len)
+			buf->disp_b = off_to_pos(buf, top + page);
+		break;
+	case KEY_PPAGE:
+		to = off >= page ? off - page : off % n;
+		buf->disp_b = off_to_pos(buf, top >= page ? top - page : 0);
+		break;
+	case KEY_HOME:
+		to = off / n * n;
+		break;
+	case KEY_END:
+		to = off / n * n + n - 1;
+		if (to > len)
+			to = len;
+		break;
+	case KEY_DC:
+		delete_bytes(buf, off, 1);
+		return true;
+	case KEY_BACKSPACE:
+	case ALT_BACKSPACE:
+		if (off)
+			delete_bytes(buf, off - 1, 1);
+		return true;
+	default:
+		if (ch >= '0' && ch <= '9')
+			hex_put(buf, ch - '0');
+		else if (ch >= 'a' && ch <= 'f')
+			hex_put(buf, ch - 'a' + 10);
+		else if (ch >= 'A' && ch <= 'F')
+			hex_put(buf, ch - 'A' + 10);
+		else if (ch != '\n' && ch != '\t' && (ch < ' ' || ch > 0xff))
+			return false;
+		return true;
+	}
+
+	buf->cursor = off_to_ptr(buf, to);
+	return true;
+}
+
+static void hex_put(struct buffer *buf, int digit)
+{
+	size_t off = ptr_to_off(buf, buf->cursor);
+	bool low = nibble.buf == buf && nibble.off == off
+	           && nibble.changes == buf->changes;
+	unsigned char ch = 0;
+	if (off < buf_len(buf))
+		ch = *off_to_ptr(buf, off);
+	ch = low ? (ch & 0xf0) | digit : (ch & 0x0f) | digit << 4;
+
+	// byte is added only at the end, others are changed in place
+	nibble.buf = NULL;
+	int rc = (off < buf_len(buf)) ? set_bytes(buf, off, (char *)&ch, 1)
+	                              : insert_bytes(buf, off, (char *)&ch, 1);
+	if (rc != SUCCESS) {
+		log_ss("error", "hex_put fail");
+		return;
+	}
+
+	buf->cursor = off_to_ptr(buf, low ? off + 1 : off);
+	if (!low)
+		nibble = (struct nibble){buf, off, buf->changes};
+}
+
+// text view is shown from the line with cursor, which is moved to begin
+// of its symbol
+static void toggle_hex(struct buffer *buf)
+{
+	buf->hex = !buf->hex;
+	buf->sel = NULL;
+	if (buf->hex)
+		return;
+
+	size_t off = ptr_to_off(buf, buf->cursor);
+	while (off && ISFILL(*off_to_ptr(buf, off)))
+		off--;
+	buf->cursor = off_to_ptr(buf, off);
+	buf->disp_b = ptr_to_line_b(buf, buf->cursor);
+}
+
+// line ends the file is saved with
+static bool toggle_eol(struct buffer *buf)
+{
+	buf->eol = (buf->eol == EOL_CRLF) ? EOL_LF : EOL_CRLF;
+	win_draw();
+	status_msg(buf->eol == EOL_CRLF ? "File is saved with CRLF"
+	                                : "File is saved with LF");
+	return false;
+}
+
+static bool toggle_strip(struct buffer *buf)
+{
+	buf->strip_ws = !buf->strip_ws;
+	win_draw();
+	status_msg(buf->strip_ws ? "Trailing spaces are stripped on save"
+	                         : "Trailing spaces are saved");
+	return false;
+}
+
 static void copy_selection(struct buffer *buf)
 {
 	if (buf->sel) {
@@ -271,6 +1208,8 @@ static void delete(struct buffer *buf)
 	if (buf->sel) {
 		del_sel(buf);
 		buf->sel = NULL;
+	} else if (multi(buf)) {
+		mc_del(buf, 0);
 	} else {
 		del_symb(buf);
 	}
@@ -281,6 +1220,8 @@ static void delete_prev(struct buffer *buf)
 	if (buf->sel) {
 		del_sel(buf);
 		buf->sel = NULL;
+	} else if (multi(buf)) {
+		mc_del(buf, 1);
 	} else {
 		del_prev_symb(buf);
 	}
@@ -288,12 +1229,12 @@ static void delete_prev(struct buffer *buf)
 
 static void pg_down(struct buffer *buf)
 {
-	mv_by_lines(buf, LINESONPAGE, DIR_LINENEXT);
+	mv_by_lines(buf, win_rows() / 2, DIR_LINENEXT);
 }
 
 static void pg_up(struct buffer *buf)
 {
-	mv_by_lines(buf, LINESONPAGE, DIR_LINEPREV);
+	mv_by_lines(buf, win_rows() / 2, DIR_LINEPREV);
 }
 
 static void home(struct buffer *buf)
@@ -308,14 +1249,286 @@ static void end(struct buffer *buf)
 
 static int add_symbol(struct buffer *buf, char ch)
 {
+	if (multi(buf)) {
+		char str[UTF_BUF_SIZE];
+		int symb_len = get_symb_len(ch); 
+		str[0] = ch;
+		for (int i = 1; i < symb_len; i++)
+			str[i] = read_key();
+		buf->sel = NULL;
+		return mc_insert(buf, str, symb_len);
+	}
+
 	bool ok = (add_ch(buf, ch) == SUCCESS);
 	if (ok) {
 		int symb_len = get_symb_len(ch); 
 		for (int i = 1; i < symb_len && ok; i++) {
-			ch = getch();
+			ch = read_key();
 			ok = (add_ch(buf, ch) == SUCCESS);
 		}
 	}
 
 	return (ok ? SUCCESS : ERROR);
 }
+
+// true if there are additional cursors
+static bool multi(struct buffer const *buf)
+{
+	return (buf->mc && buf->mc->num);
+}
+
+// ask for line[:col] or @offset and move cursor there
+static void go_to(struct buffer *buf)
+{
+	char str[COLS_MAX] = "";
+	get_input("Go to line[:col] or @byte offset: ", str, sizeof(str) - 1);
+	mc_clear(buf);
+
+	if (str[0] == '@') {
+		size_t off = strtoull(str + 1, NULL, 10);
+		if (off > buf_len(buf))
+			off = buf_len(buf);
+		while (off && ISFILL(*off_to_ptr(buf, off)))
+			off--;
+
+		char *p = off_to_ptr(buf, off);
+		edit_goto(buf, line_num(buf, p) + 1, col_num(buf, p) + 1);
+		return;
+	}
+
+	char *end;
+	size_t line = strtoull(str, &end, 10);
+	int col = (*end == ':') ? atoi(end + 1) : 0;
+	if (line)
+		edit_goto(buf, line, col);
+}
+
+// selection or whole text is replaced by output of command, false if
+// message about failure is shown
+static bool pipe_through(struct buffer *buf)
+{
+	char cmd[COLS_MAX] = "";
+	get_input("Pipe through command: ", cmd, sizeof(cmd) - 1);
+	if (!cmd[0])
+		return true;
+
+	size_t off = 0;
+	size_t len = buf_len(buf);
+	if (buf->sel) {
+		size_t sel = ptr_to_off(buf, buf->sel);
+		size_t cur = ptr_to_off(buf, buf->cursor);
+		off = sel < cur ? sel : cur;
+		len = sel < cur ? cur - sel : sel - cur;
+	}
+
+	mc_clear(buf);
+	int status;
+	if (filter_region(buf, off, len, cmd, &status) != SUCCESS) {
+		log_ss("error", "filter_region fail");
+		msg("Command can't be run");
+		return false;
+	}
+	if (status) {
+		char str[COLS_MAX];
+		snprintf(str, sizeof(str),
+		         "Command failed (status %d), text is kept", status);
+		msg(str);
+		return false;
+	}
+
+	buf->sel = NULL;
+	return true;
+}
+
+// all matches are searched in background, cursor goes to the first one
+// after it when it's found
+static bool find_all(struct buffer *buf)
+{
+	char pat[FIND_MAX + 1] = "";
+	get_input("Find all: ", pat, FIND_MAX);
+	find_stop();
+	if (!pat[0])
+		return true;
+
+	size_t from = ptr_to_off(buf, buf->cursor);
+	found = search_start(buf, pat, strlen(pat), from);
+	if (!found) {
+		log_ss("error", "search_start fail");
+		msg("Search can't be started");
+		return false;
+	}
+
+	// match right at the cursor counts as the next one
+	found_buf = buf;
+	found_jump = true;
+	found_prev = false;
+	found_off = from;
+	find_tick();
+	return true;
+}
+
+static bool find_step(struct buffer *buf, bool prev)
+{
+	if (!found || found_buf != buf) {
+		msg("Find text with ^F first");
+		return false;
+	}
+	if (found->changes != buf->changes) {
+		find_stop();
+		msg("Text was changed, find it again with ^F");
+		return false;
+	}
+
+	found_jump = true;
+	found_prev = prev;
+	found_off = ptr_to_off(buf, buf->cursor) + !prev;
+	return find_tick();
+}
+
+// cursor is moved to the match that was waited for. Search of text that
+// was changed is stopped, its offsets are of no use
+static bool find_tick(void)
+{
+	if (!found)
+		return false;
+	if (found->changes != found_buf->changes) {
+		find_stop();
+		return false;
+	}
+	if (!found_jump || win_buf() != found_buf)
+		return false;
+
+	struct buffer *buf = found_buf;
+	long off = search_next(found, found_off, found_prev);
+	if (off == -2)
+		return false;
+
+	found_jump = false;
+	if (off < 0) {
+		msg("Not found");
+		return false;
+	}
+	show_match(buf, off);
+	return false;
+}
+
+static void find_stop(void)
+{
+	search_stop(found);
+	found = NULL;
+	found_buf = NULL;
+	found_jump = false;
+}
+
+static void show_match(struct buffer *buf, size_t off)
+{
+	char *p = off_to_ptr(buf, off);
+	edit_goto(buf, line_num(buf, p) + 1, col_num(buf, p) + 1);
+
+	int done;
+	size_t num = search_count(found, &done);
+	size_t i = search_index(found, off);
+	char str[COLS_MAX];
+	if (done && i)
+		snprintf(str, sizeof(str), "Match %zu of %zu", i, num);
+	else
+		snprintf(str, sizeof(str), "Match, %zu found so far", num);
+
+	win_draw();
+	status_msg(str);
+}
+
+// add file to the list, buf is NULL if file should be loaded later
+static int add_file(char const *fname, struct buffer *buf)
+{
+	struct file_node *p = realloc(files,
+	                              (files_num + 1) * sizeof(*files));
+	if (!p)
+		return ERROR;
+	files = p;
+
+	struct file_node *f = &files[files_num++];
+	snprintf(f->name, sizeof(f->name), "%s", fname ? fname : "");
+	f->buf = buf;
+	return SUCCESS;
+}
+
+// buffer with the file, or new one if there is no such file yet.
+// NULL if file can't be loaded
+static struct buffer * open_file(char const *fname)
+{
+	struct buffer *buf = create_buffer();
+	if (!buf) {
+		log_ss("error", "create_buffer fail");
+		msg("Error. Details in " LOGFILE);
+		getch();
+		return NULL;
+	}
+
+	if (file_exists(fname)) {
+		if (load_file(buf, fname) == ERROR) {
+			log_ss("error", "load_file fail");
+			msg("Error. Details in " LOGFILE);
+			getch();
+			delete_buffer(buf);
+			return NULL;
+		}
+	} else {
+		snprintf(buf->filename, FNAMELEN_MAX, "%s", fname);
+	}
+	recover(buf);
+
+	return buf;
+}
+
+// show next file of the list in active window, loading it if it wasn't
+// shown yet. Files that can't be loaded are skipped
+static void next_file(void)
+{
+	struct buffer *cur = win_buf();
+	size_t i = 0;
+	while (i < files_num && files[i].buf != cur)
+		i++;
+
+	for (size_t k = 1; k < files_num; k++) {
+		struct file_node *f = &files[(i + k) % files_num];
+		if (!f->buf && strlen(f->name))
+			f->buf = open_file(f->name);
+		if (f->buf) {
+			win_show(f->buf);
+			return;
+		}
+	}
+}
+
+// read background input of all loaded buffers, returns true if some
+// of them was changed
+static bool tick_all(void)
+{
+	bool changed = false;
+	for (size_t i = 0; i < files_num; i++) {
+		struct buffer *b = files[i].buf;
+		if (!b)
+			continue;
+		changed = stream_tick(b) || changed;
+		changed = follow_tick(b) || changed;
+		changed = count_tick(b) || changed;
+	}
+	return find_tick() || changed;
+}
+
+// shortest input timeout of loaded buffers
+static int timeout_all(void)
+{
+	int t = -1;
+	for (size_t i = 0; i < files_num; i++) {
+		if (!files[i].buf)
+			continue;
+		int bt = input_timeout(files[i].buf);
+		if (bt >= 0 && (t < 0 || bt < t))
+			t = bt;
+	}
+	if (found_jump && (t < 0 || t > SEARCH_WAIT_MS))
+		t = SEARCH_WAIT_MS;
+	return t;
+}
@@ -2,13 +2,22 @@
 #define EDIT_H
 #include <stdio.h>
 
+struct buffer;
+
 // prepare terminal, load file in buffer for edit or create empty new buffer
 struct buffer * edit_prepare(char const *fname);
 
+// add file that is loaded when it's shown first time
+int edit_add(char const *fname);
+
+// move cursor to line and column (both from 1, 0 is the first one too),
+// the line is shown in the middle of the screen
+void edit_goto(struct buffer *buf, size_t line, int col);
+
 // main editor loop
 int edit_run(struct buffer *buf);
 
-// frees memory, finishing ncurses mode
+// frees memory of all buffers, finishing ncurses mode
 int edit_end(struct buffer *buf);
 
 #endif /* EDIT_H */
@@ -0,0 +1,245 @@
+#include "filter.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// output of command read so far
+struct output {
+	char *mem;
+	size_t len;
+	size_t size;
+};
+
+static pid_t run(char const *cmd, int *in_fd, int *out_fd);
+static int feed(int fd, struct iovec *iov, int *iov_num, int *use_splice);
+static int drain(int fd, struct output *out);
+static int set_nonblock(int fd);
+
+int filter_region(struct buffer *buf, size_t off, size_t len,
+                  char const *cmd, int *status)
+{
+	size_t text_len = buf_len(buf);
+	if (off > text_len)
+		return ERROR;
+	if (len > text_len - off)
+		len = text_len - off;
+
+	// command that doesn't read its input shouldn't kill the editor
+	struct sigaction ign = {0}, old;
+	ign.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ign, &old);
+
+	int in_fd, out_fd;
+	pid_t pid = run(cmd, &in_fd, &out_fd);
+	if (pid < 0) {
+		sigaction(SIGPIPE, &old, NULL);
+		return ERROR;
+	}
+
+	// range is given from both sides of the gap, buffer isn't changed
+	// until the command is done, so pages given to pipe stay the same
+	struct iovec iov[2];
+	int iov_num = 0;
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	if (off < before_gap && len) {
+		size_t n = before_gap - off < len ? before_gap - off : len;
+		iov[iov_num++] = (struct iovec){buf->buf_b + off, n};
+	}
+	if (off + len > before_gap) {
+		size_t from = off > before_gap ? off : before_gap;
+		char *p = buf->gap_e + (from - before_gap);
+		iov[iov_num++] = (struct iovec){p, off + len - from};
+	}
+
+	struct output out = {0};
+	int use_splice = 1;
+	int rc = SUCCESS;
+
+	while (out_fd >= 0 && rc == SUCCESS) {
+		if (in_fd >= 0 && !iov_num) {
+			close(in_fd);
+			in_fd = -1;
+		}
+
+		struct pollfd fds[2] = {
+			{.fd = out_fd, .events = POLLIN},
+			{.fd = in_fd, .events = POLLOUT},
+		};
+		if (poll(fds, in_fd >= 0 ? 2 : 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = ERROR;
+			break;
+		}
+
+		if (in_fd >= 0 && fds[1].revents) {
+			int r = feed(in_fd, iov, &iov_num, &use_splice);
+			if (r == ERROR) {
+				// command stopped reading, its output is
+				// still taken
+				iov_num = 0;
+			}
+		}
+
+		if (fds[0].revents) {
+			int r = drain(out_fd, &out);
+			if (r < 0)
+				rc = ERROR;
+			else if (!r) {
+				close(out_fd);
+				out_fd = -1;
+			}
+		}
+	}
+
+	if (in_fd >= 0)
+		close(in_fd);
+	if (out_fd >= 0)
+		close(out_fd);
+
+	int wstatus;
+	pid_t w;
+	while ((w = waitpid(pid, &wstatus, 0)) < 0 && errno == EINTR)
+		;
+	sigaction(SIGPIPE, &old, NULL);
+	if (w < 0) {
+		log_ss("error", "filter wait fail");
+		*status = -1;
+		rc = ERROR;
+	} else {
+		*status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+	}
+
+	log_si("filter_region in", (int)len);
+	log_si("filter_region out", (int)out.len);
+	log_si("filter_region splice", use_splice);
+
+	if (rc == SUCCESS && !*status)
+		rc = replace_bytes(buf, off, len, out.mem ? out.mem : "",
+		                   out.len);
+
+	free(out.mem);
+	return rc;
+}
+
+// command is run by shell with pipes on its stdin and stdout, stderr
+// goes nowhere as it would spoil the screen
+static pid_t run(char const *cmd, int *in_fd, int *out_fd)
+{
+	int in[2], out[2];
+	if (pipe2(in, O_CLOEXEC) < 0)
+		return -1;
+	if (pipe2(out, O_CLOEXEC) < 0) {
+		close(in[0]);
+		close(in[1]);
+		return -1;
+	}
+
+	pid_t pid = fork();
+	if (!pid) {
+		int null_fd = open("/dev/null", O_WRONLY);
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		if (null_fd >= 0)
+			dup2(null_fd, STDERR_FILENO);
+		// ignored SIGPIPE would be kept by the command
+		signal(SIGPIPE, SIG_DFL);
+		execl(FILTER_SHELL, "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	if (pid < 0 || set_nonblock(in[1]) != SUCCESS
+	    || set_nonblock(out[0]) != SUCCESS) {
+		log_ss("error", "filter run fail");
+		close(in[1]);
+		close(out[0]);
+		if (pid > 0)
+			waitpid(pid, NULL, 0);
+		return -1;
+	}
+
+	*in_fd = in[1];
+	*out_fd = out[0];
+	return pid;
+}
+
+/*
+ * vmsplice maps buffer pages to the pipe instead of copying them, writev
+ * is used if pipe doesn't take them. Returns ERROR if command doesn't
+ * read any more.
+ */
+static int feed(int fd, struct iovec *iov, int *iov_num, int *use_splice)
+{
+	ssize_t n = -1;
+	if (*use_splice) {
+		n = vmsplice(fd, iov, *iov_num, SPLICE_F_NONBLOCK);
+		if (n < 0 && errno != EAGAIN && errno != EINTR
+		    && errno != EPIPE)
+			*use_splice = 0;
+	}
+	if (!*use_splice)
+		n = writev(fd, iov, *iov_num);
+
+	if (n < 0)
+		return (errno == EAGAIN || errno == EINTR) ? SUCCESS : ERROR;
+
+	size_t done = n;
+	if (done >= iov[0].iov_len) {
+		done -= iov[0].iov_len;
+		if (--(*iov_num))
+			iov[0] = iov[1];
+	}
+	if (*iov_num) {
+		iov[0].iov_base = (char *)iov[0].iov_base + done;
+		iov[0].iov_len -= done;
+	}
+
+	return SUCCESS;
+}
+
+// read what is ready, returns 0 at the end of output, -1 on error
+static int drain(int fd, struct output *out)
+{
+	for (;;) {
+		if (out->len == out->size) {
+			size_t size = out->size ? out->size * 2 : FILTER_CHUNK;
+			char *p = realloc(out->mem, size);
+			if (!p) {
+				log_ss("error", "filter drain realloc fail");
+				return -1;
+			}
+			out->mem = p;
+			out->size = size;
+		}
+
+		ssize_t n = read(fd, out->mem + out->len, out->size - out->len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return 1;
+		if (n < 0)
+			return -1;
+		if (!n)
+			return 0;
+		out->len += n;
+	}
+}
+
+static int set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return ERROR;
+	return SUCCESS;
+}
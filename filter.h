@@ -0,0 +1,21 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "buffer.h"
+
+#define FILTER_CHUNK (64 * 1024)   // first size of output memory
+#define FILTER_SHELL "/bin/sh"
+
+/*
+ * Text is passed through a shell command: the range is given to its
+ * stdin right from buffer memory (vmsplice of the two sides of the gap)
+ * while its stdout is read, so large outputs can't block the command.
+ * The range is replaced by the output if the command exits with 0.
+ */
+
+// pass len bytes at offset through cmd, status is set to its exit status
+// (or -1 if it was killed). ERROR if command can't be run
+int filter_region(struct buffer *buf, size_t off, size_t len,
+                  char const *cmd, int *status);
+
+#endif /* FILTER_H */
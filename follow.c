@@ -0,0 +1,110 @@
+#include "follow.h"
+#include "buffer.h"
+#include "journal.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define EVENTS_BUF_SIZE 4096
+
+static int has_events(struct follow *fl);
+
+int follow_start(struct buffer *buf)
+{
+	if (buf->follow)
+		return SUCCESS;
+
+	if (!strlen(buf->filename))
+		return ERROR;
+
+	struct follow *fl = calloc(1, sizeof(struct follow));
+	if (!fl)
+		return ERROR;
+
+	fl->fd = open(buf->filename, O_RDONLY);
+	if (fl->fd < 0) {
+		log_ss("error", "follow_start open fail");
+		free(fl);
+		return ERROR;
+	}
+
+	fl->ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fl->ino_fd >= 0
+	    && inotify_add_watch(fl->ino_fd, buf->filename, IN_MODIFY) < 0) {
+		close(fl->ino_fd);
+		fl->ino_fd = -1;
+	}
+	if (fl->ino_fd < 0)
+		log_ss("follow", "inotify is not available, using stat");
+
+	fl->check = 1;
+	buf->follow = fl;
+	return SUCCESS;
+}
+
+void follow_stop(struct buffer *buf)
+{
+	struct follow *fl = buf->follow;
+	if (!fl)
+		return;
+
+	if (fl->ino_fd >= 0)
+		close(fl->ino_fd);
+	close(fl->fd);
+	free(fl);
+	buf->follow = NULL;
+}
+
+long follow_update(struct buffer *buf)
+{
+	struct follow *fl = buf->follow;
+	if (!fl)
+		return 0;
+
+	if (!has_events(fl) && !fl->check)
+		return 0;
+	fl->check = 0;
+
+	struct stat st;
+	if (fstat(fl->fd, &st) != 0)
+		return -1;
+
+	size_t fsize = (size_t)st.st_size;
+	if (fsize < buf->finfo.size)
+		return -1;
+	if (fsize == buf->finfo.size)
+		return 0;
+
+	long bytes = append_from_fd(buf, fl->fd, buf->finfo.size,
+	                            fsize - buf->finfo.size);
+	if (bytes < 0) {
+		log_ss("error", "follow_update append_from_fd fail");
+		return -1;
+	}
+
+	update_finfo(buf, buf->finfo.size + bytes);
+	// otherwise replay would reject the journal for the grown file
+	if (journal_rehead(buf) != SUCCESS)
+		log_ss("error", "follow_update journal_rehead fail");
+	return bytes;
+}
+
+// drain inotify queue, returns 1 if there were events
+static int has_events(struct follow *fl)
+{
+	if (fl->ino_fd < 0)
+		return 1;
+
+	char events[EVENTS_BUF_SIZE];
+	int ret = 0;
+	while (read(fl->ino_fd, events, sizeof(events)) > 0)
+		ret = 1;
+
+	return ret;
+}
@@ -0,0 +1,30 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include "buffer.h"
+
+#define FOLLOW_POLL_MS 200
+#define FOLLOW_CHUNK (64 * 1024)
+
+/*
+ * Follow mode (like tail -f): bytes appended to the file by other
+ * processes are read from buf->finfo.size offset and added to the end
+ * of the buffer.
+ */
+struct follow {
+	int fd;        // file that is followed
+	int ino_fd;    // inotify descriptor or -1 if stat polling is used
+	int check;     // check file size on next update even without events
+};
+
+// start following buffer file
+int follow_start(struct buffer *buf);
+
+// stop following buffer file
+void follow_stop(struct buffer *buf);
+
+// read bytes appended to file since last call. returns number of bytes
+// that were added to buffer or -1 on error (file was truncated)
+long follow_update(struct buffer *buf);
+
+#endif /* FOLLOW_H */
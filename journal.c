@@ -0,0 +1,569 @@
+#include "journal.h"
+#include "buffer.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC "EDITJNL1"
+#define MAGIC_LEN 8
+#define HDR_SIZE (MAGIC_LEN + 2 * sizeof(uint64_t))
+#define REC_HDR_SIZE (1 + 2 * sizeof(uint64_t))
+
+struct rec_hdr {
+	char op;
+	uint64_t off;
+	uint64_t len;
+};
+
+static void journal_path(char const *fname, char *path, size_t size);
+static void base_stat(char const *fname, uint64_t *size, uint64_t *mtime);
+static int write_all(int fd, char const *p, size_t len);
+static int read_all(int fd, char *p, size_t len);
+static int write_header(int fd, char const *fname);
+static void get_rec(char const *p, struct rec_hdr *rec);
+static void put_rec(char *p, struct rec_hdr const *rec);
+static int reserve(struct journal *jnl, size_t len);
+static void append_rec(struct journal *jnl, char op, size_t off,
+                       char const *data, size_t len);
+static void lose_rec(struct journal *jnl);
+static bool merge_set(struct journal *jnl, struct rec_hdr *last,
+                      size_t off, char const *data, size_t len);
+static void * sync_thread(void *arg);
+
+int journal_exists(char const *fname)
+{
+	char path[JOURNAL_FNAME_MAX];
+	journal_path(fname, path, sizeof(path));
+
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return 0;
+
+	return ((size_t)st.st_size > HDR_SIZE);
+}
+
+int journal_replay(struct buffer *buf)
+{
+	char path[JOURNAL_FNAME_MAX];
+	journal_path(buf->filename, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		log_ss("error", "journal_replay open fail");
+		return ERROR;
+	}
+
+	char hdr[HDR_SIZE];
+	uint64_t size, mtime, jnl_size, jnl_mtime;
+	base_stat(buf->filename, &size, &mtime);
+	if (read_all(fd, hdr, HDR_SIZE) != SUCCESS
+	    || memcmp(hdr, JOURNAL_MAGIC, MAGIC_LEN) != 0) {
+		log_ss("error", "journal_replay bad header");
+		close(fd);
+		return ERROR;
+	}
+
+	memcpy(&jnl_size, hdr + MAGIC_LEN, sizeof(jnl_size));
+	memcpy(&jnl_mtime, hdr + MAGIC_LEN + sizeof(jnl_size),
+	       sizeof(jnl_mtime));
+	if (jnl_size != size || jnl_mtime != mtime) {
+		log_ss("error", "journal_replay file was changed");
+		close(fd);
+		return ERROR;
+	}
+
+	char *data = NULL;
+	size_t data_size = 0;
+	bool ok = true;
+	char rec_buf[REC_HDR_SIZE];
+	while (ok && read_all(fd, rec_buf, REC_HDR_SIZE) == SUCCESS) {
+		struct rec_hdr rec;
+		get_rec(rec_buf, &rec);
+
+		if (rec.off > buf_len(buf))
+			break;
+
+		if (rec.op == JOURNAL_DEL) {
+			delete_bytes(buf, rec.off, rec.len);
+			continue;
+		} else if (rec.op != JOURNAL_INS && rec.op != JOURNAL_SET) {
+			break;
+		}
+
+		if (rec.len > data_size) {
+			char *tmp = realloc(data, rec.len);
+			if (!tmp) {
+				ok = false;
+				break;
+			}
+			data = tmp;
+			data_size = rec.len;
+		}
+
+		// record could be cut off by crash, stop on it
+		if (read_all(fd, data, rec.len) != SUCCESS)
+			break;
+
+		int rc = (rec.op == JOURNAL_SET)
+		         ? set_bytes(buf, rec.off, data, rec.len)
+		         : insert_bytes(buf, rec.off, data, rec.len);
+		ok = (rc == SUCCESS);
+	}
+
+	free(data);
+	close(fd);
+
+	if (!ok)
+		log_ss("error", "journal_replay insert fail");
+
+	return (ok ? SUCCESS : ERROR);
+}
+
+int journal_open(struct buffer *buf, int keep)
+{
+	if (!strlen(buf->filename))
+		return SUCCESS;
+
+	struct journal *jnl = calloc(1, sizeof(struct journal));
+	if (!jnl)
+		return ERROR;
+
+	journal_path(buf->filename, jnl->fname, sizeof(jnl->fname));
+
+	int flags = O_WRONLY | O_CREAT | O_APPEND;
+	if (!keep)
+		flags |= O_TRUNC;
+
+	jnl->fd = open(jnl->fname, flags, 0600);
+	if (jnl->fd < 0) {
+		log_ss("error", "journal_open open fail");
+		free(jnl);
+		return ERROR;
+	}
+
+	if (!keep && write_header(jnl->fd, buf->filename) != SUCCESS) {
+		log_ss("error", "journal_open write header fail");
+		close(jnl->fd);
+		unlink(jnl->fname);
+		free(jnl);
+		return ERROR;
+	}
+
+	jnl->pend_size = JOURNAL_BUF_SIZE;
+	jnl->pend = malloc(jnl->pend_size);
+	jnl->last_rec = SIZE_MAX;
+	if (!jnl->pend) {
+		close(jnl->fd);
+		free(jnl);
+		return ERROR;
+	}
+
+	pthread_mutex_init(&jnl->lock, NULL);
+	pthread_mutex_init(&jnl->io_lock, NULL);
+	pthread_cond_init(&jnl->wake, NULL);
+
+	if (pthread_create(&jnl->thread, NULL, sync_thread, jnl) != 0) {
+		log_ss("error", "journal_open pthread_create fail");
+		pthread_cond_destroy(&jnl->wake);
+		pthread_mutex_destroy(&jnl->io_lock);
+		pthread_mutex_destroy(&jnl->lock);
+		close(jnl->fd);
+		free(jnl->pend);
+		free(jnl);
+		return ERROR;
+	}
+
+	buf->jnl = jnl;
+	return SUCCESS;
+}
+
+void journal_close(struct buffer *buf, int remove)
+{
+	struct journal *jnl = buf->jnl;
+	if (!jnl)
+		return;
+
+	pthread_mutex_lock(&jnl->lock);
+	jnl->stop = 1;
+	pthread_cond_signal(&jnl->wake);
+	pthread_mutex_unlock(&jnl->lock);
+	pthread_join(jnl->thread, NULL);
+
+	close(jnl->fd);
+	if (remove)
+		unlink(jnl->fname);
+
+	pthread_cond_destroy(&jnl->wake);
+	pthread_mutex_destroy(&jnl->io_lock);
+	pthread_mutex_destroy(&jnl->lock);
+	free(jnl->pend);
+	free(jnl);
+	buf->jnl = NULL;
+}
+
+int journal_reset(struct buffer *buf)
+{
+	struct journal *jnl = buf->jnl;
+	if (!jnl)
+		return SUCCESS;
+
+	pthread_mutex_lock(&jnl->io_lock);
+
+	pthread_mutex_lock(&jnl->lock);
+	jnl->pend_len = 0;
+	jnl->last_rec = SIZE_MAX;
+	jnl->failed = 0;
+	pthread_mutex_unlock(&jnl->lock);
+
+	int ret = SUCCESS;
+	if (ftruncate(jnl->fd, 0) != 0
+	    || write_header(jnl->fd, buf->filename) != SUCCESS) {
+		log_ss("error", "journal_reset fail");
+		ret = ERROR;
+	}
+
+	pthread_mutex_unlock(&jnl->io_lock);
+	return ret;
+}
+
+/*
+ * Journal fd is opened with O_APPEND, so the header is written through
+ * another fd. Records stay, they apply to the grown file as well since
+ * it only got bytes at its end.
+ */
+int journal_rehead(struct buffer *buf)
+{
+	struct journal *jnl = buf->jnl;
+	if (!jnl)
+		return SUCCESS;
+
+	pthread_mutex_lock(&jnl->io_lock);
+
+	int ret = SUCCESS;
+	int fd = open(jnl->fname, O_WRONLY);
+	if (fd < 0 || write_header(fd, buf->filename) != SUCCESS
+	    || fdatasync(fd) != 0) {
+		log_ss("error", "journal_rehead fail");
+		ret = ERROR;
+	}
+	if (fd >= 0)
+		close(fd);
+
+	pthread_mutex_unlock(&jnl->io_lock);
+	return ret;
+}
+
+void journal_ins(struct journal *jnl, size_t off, char const *data,
+                 size_t len)
+{
+	if (!jnl || !len)
+		return;
+
+	pthread_mutex_lock(&jnl->lock);
+	append_rec(jnl, JOURNAL_INS, off, data, len);
+	pthread_mutex_unlock(&jnl->lock);
+}
+
+void journal_set(struct journal *jnl, size_t off, char const *data,
+                 size_t len)
+{
+	if (!jnl || !len)
+		return;
+
+	pthread_mutex_lock(&jnl->lock);
+	append_rec(jnl, JOURNAL_SET, off, data, len);
+	pthread_mutex_unlock(&jnl->lock);
+}
+
+void journal_del(struct journal *jnl, size_t off, size_t len)
+{
+	if (!jnl || !len)
+		return;
+
+	pthread_mutex_lock(&jnl->lock);
+	append_rec(jnl, JOURNAL_DEL, off, NULL, len);
+	pthread_mutex_unlock(&jnl->lock);
+}
+
+static void journal_path(char const *fname, char *path, size_t size)
+{
+	char const *base = strrchr(fname, '/');
+	base = base ? base + 1 : fname;
+	int dir_len = (int)(base - fname);
+
+	snprintf(path, size, "%.*s" JOURNAL_PREFIX "%s" JOURNAL_SUFFIX,
+	         dir_len, fname, base);
+}
+
+static void base_stat(char const *fname, uint64_t *size, uint64_t *mtime)
+{
+	struct stat st;
+	if (stat(fname, &st) != 0) {
+		*size = 0;
+		*mtime = 0;
+		return;
+	}
+
+	*size = (uint64_t)st.st_size;
+	*mtime = (uint64_t)st.st_mtime;
+}
+
+static int write_all(int fd, char const *p, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return ERROR;
+		p += n;
+		len -= n;
+	}
+	return SUCCESS;
+}
+
+static int read_all(int fd, char *p, size_t len)
+{
+	while (len) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return ERROR;
+		p += n;
+		len -= n;
+	}
+	return SUCCESS;
+}
+
+static int write_header(int fd, char const *fname)
+{
+	char hdr[HDR_SIZE];
+	uint64_t size, mtime;
+	base_stat(fname, &size, &mtime);
+
+	memcpy(hdr, JOURNAL_MAGIC, MAGIC_LEN);
+	memcpy(hdr + MAGIC_LEN, &size, sizeof(size));
+	memcpy(hdr + MAGIC_LEN + sizeof(size), &mtime, sizeof(mtime));
+
+	return write_all(fd, hdr, HDR_SIZE);
+}
+
+static void get_rec(char const *p, struct rec_hdr *rec)
+{
+	rec->op = p[0];
+	memcpy(&rec->off, p + 1, sizeof(rec->off));
+	memcpy(&rec->len, p + 1 + sizeof(rec->off), sizeof(rec->len));
+}
+
+static void put_rec(char *p, struct rec_hdr const *rec)
+{
+	p[0] = rec->op;
+	memcpy(p + 1, &rec->off, sizeof(rec->off));
+	memcpy(p + 1 + sizeof(rec->off), &rec->len, sizeof(rec->len));
+}
+
+static int reserve(struct journal *jnl, size_t len)
+{
+	if (jnl->pend_len + len <= jnl->pend_size)
+		return SUCCESS;
+
+	size_t new_size = jnl->pend_size * 2;
+	if (new_size < jnl->pend_len + len)
+		new_size = jnl->pend_len + len;
+
+	char *tmp = realloc(jnl->pend, new_size);
+	if (!tmp)
+		return ERROR;
+
+	jnl->pend = tmp;
+	jnl->pend_size = new_size;
+	return SUCCESS;
+}
+
+/*
+ * Typing and deleting in one place produce a lot of one byte operations,
+ * so they are merged into the last record while it is still in memory.
+ */
+static void append_rec(struct journal *jnl, char op, size_t off,
+                       char const *data, size_t len)
+{
+	if (jnl->failed)
+		return;
+
+	struct rec_hdr last;
+	bool has_last = (jnl->last_rec != SIZE_MAX);
+	if (has_last)
+		get_rec(jnl->pend + jnl->last_rec, &last);
+
+	if (has_last && op == JOURNAL_INS && last.op == JOURNAL_INS
+	    && last.off + last.len == off) {
+		if (reserve(jnl, len) != SUCCESS) {
+			lose_rec(jnl);
+			return;
+		}
+		memcpy(jnl->pend + jnl->pend_len, data, len);
+		jnl->pend_len += len;
+		last.len += len;
+		put_rec(jnl->pend + jnl->last_rec, &last);
+		return;
+	}
+
+	if (has_last && op == JOURNAL_DEL && last.op == JOURNAL_INS
+	    && off >= last.off && off + len == last.off + last.len) {
+		jnl->pend_len -= len;
+		last.len -= len;
+		if (last.len) {
+			put_rec(jnl->pend + jnl->last_rec, &last);
+		} else {
+			jnl->pend_len = jnl->last_rec;
+			jnl->last_rec = SIZE_MAX;
+		}
+		return;
+	}
+
+	if (has_last && op == JOURNAL_DEL && last.op == JOURNAL_DEL
+	    && (last.off == off || off + len == last.off)) {
+		last.off = off;
+		last.len += len;
+		put_rec(jnl->pend + jnl->last_rec, &last);
+		return;
+	}
+
+	if (has_last && op == JOURNAL_SET && merge_set(jnl, &last, off, data,
+	                                                len))
+		return;
+
+	size_t data_len = (op == JOURNAL_DEL) ? 0 : len;
+	if (reserve(jnl, REC_HDR_SIZE + data_len) != SUCCESS) {
+		lose_rec(jnl);
+		return;
+	}
+
+	struct rec_hdr rec = { op, off, len };
+	jnl->last_rec = jnl->pend_len;
+	put_rec(jnl->pend + jnl->pend_len, &rec);
+	jnl->pend_len += REC_HDR_SIZE;
+	if (data_len) {
+		memcpy(jnl->pend + jnl->pend_len, data, data_len);
+		jnl->pend_len += data_len;
+	}
+
+	if (jnl->pend_len >= JOURNAL_BUF_SIZE)
+		pthread_cond_signal(&jnl->wake);
+}
+
+/*
+ * Records after a lost one would be replayed at wrong offsets, so no
+ * more of them are kept and the file is emptied by sync thread. Saving
+ * the file resets the journal and starts it again.
+ */
+static void lose_rec(struct journal *jnl)
+{
+	log_ss("error", "journal record lost, journal is dropped");
+	jnl->failed = 1;
+	jnl->pend_len = 0;
+	jnl->last_rec = SIZE_MAX;
+	pthread_cond_signal(&jnl->wake);
+}
+
+/*
+ * Overwrite of bytes that the last record has put there changes its
+ * data, overwrite right after the last one extends it.
+ */
+static bool merge_set(struct journal *jnl, struct rec_hdr *last,
+                      size_t off, char const *data, size_t len)
+{
+	if (last->op != JOURNAL_INS && last->op != JOURNAL_SET)
+		return false;
+	if (off < last->off || off > last->off + last->len)
+		return false;
+
+	size_t end = last->off + last->len;
+	size_t over = off + len > end ? off + len - end : 0;
+	if (over && last->op != JOURNAL_SET)
+		return false;
+	if (over && reserve(jnl, over) != SUCCESS)
+		return false;
+
+	char *rec_data = jnl->pend + jnl->last_rec + REC_HDR_SIZE;
+	memcpy(rec_data + (off - last->off), data, len);
+	jnl->pend_len += over;
+	last->len += over;
+	put_rec(jnl->pend + jnl->last_rec, last);
+	return true;
+}
+
+/*
+ * Writes collected records once per JOURNAL_SYNC_SEC or when there are
+ * JOURNAL_BUF_SIZE bytes of them, so editor thread never waits for disk.
+ */
+static void * sync_thread(void *arg)
+{
+	struct journal *jnl = arg;
+	size_t out_size = JOURNAL_BUF_SIZE;
+	char *out = malloc(out_size);
+	bool stop = false;
+
+	if (!out) {
+		log_ss("error", "journal thread malloc fail");
+		return NULL;
+	}
+
+	while (!stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += JOURNAL_SYNC_SEC;
+
+		pthread_mutex_lock(&jnl->lock);
+		while (!jnl->stop && jnl->pend_len < JOURNAL_BUF_SIZE) {
+			if (pthread_cond_timedwait(&jnl->wake, &jnl->lock,
+			                           &deadline) == ETIMEDOUT)
+				break;
+		}
+		stop = jnl->stop;
+		pthread_mutex_unlock(&jnl->lock);
+
+		pthread_mutex_lock(&jnl->io_lock);
+		pthread_mutex_lock(&jnl->lock);
+		char *full = jnl->pend;
+		size_t full_size = jnl->pend_size;
+		size_t len = jnl->pend_len;
+		jnl->pend = out;
+		jnl->pend_size = out_size;
+		jnl->pend_len = 0;
+		jnl->last_rec = SIZE_MAX;
+		out = full;
+		out_size = full_size;
+		bool failed = jnl->failed;
+		pthread_mutex_unlock(&jnl->lock);
+
+		if (len && !failed) {
+			if (write_all(jnl->fd, out, len) != SUCCESS) {
+				log_ss("error", "journal write fail");
+				pthread_mutex_lock(&jnl->lock);
+				jnl->failed = 1;
+				pthread_mutex_unlock(&jnl->lock);
+				failed = true;
+			} else if (fdatasync(jnl->fd) != 0) {
+				log_ss("error", "journal fdatasync fail");
+			}
+		}
+		// header is dropped too, the journal isn't offered for recovery
+		if (failed && ftruncate(jnl->fd, 0) != 0)
+			log_ss("error", "journal ftruncate fail");
+		pthread_mutex_unlock(&jnl->io_lock);
+	}
+
+	free(out);
+	return NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "buffer.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOURNAL_PREFIX "."
+#define JOURNAL_SUFFIX ".swp"
+#define JOURNAL_FNAME_MAX (FNAMELEN_MAX + 8)
+#define JOURNAL_BUF_SIZE (64 * 1024)
+#define JOURNAL_SYNC_SEC 1
+
+#define JOURNAL_INS 'I'
+#define JOURNAL_DEL 'D'
+#define JOURNAL_SET 'S'
+
+/*
+ * Append-only log of edit operations kept next to the edited file.
+ * Records are collected in memory by the editor thread and written out
+ * by a separate thread in batches, followed by fdatasync.
+ */
+struct journal {
+	int fd;
+	char fname[JOURNAL_FNAME_MAX];
+	char *pend;            // records that are not written yet
+	size_t pend_len;
+	size_t pend_size;
+	size_t last_rec;       // offset of last record in pend or SIZE_MAX
+	int stop;
+	int failed;            // a record was lost, file is emptied then
+	pthread_mutex_t lock;  // protects pend, stop and failed
+	pthread_mutex_t io_lock;  // protects fd
+	pthread_cond_t wake;
+	pthread_t thread;
+};
+
+// 1 if there is journal with records for that file
+int journal_exists(char const *fname);
+
+// apply journal records to buffer that was loaded from journaled file
+int journal_replay(struct buffer *buf);
+
+// start journaling buffer. If keep is 0 old journal is discarded
+int journal_open(struct buffer *buf, int keep);
+
+// stop journaling, remove journal file if remove is not 0
+void journal_close(struct buffer *buf, int remove);
+
+// discard all records, should be called after the file was saved
+int journal_reset(struct buffer *buf);
+
+// take current size and mtime of the file that was appended to
+int journal_rehead(struct buffer *buf);
+
+// log insertion of len bytes at offset
+void journal_ins(struct journal *jnl, size_t off, char const *data,
+                 size_t len);
+
+// log overwrite of len bytes at offset with data
+void journal_set(struct journal *jnl, size_t off, char const *data,
+                 size_t len);
+
+// log deletion of len bytes at offset
+void journal_del(struct journal *jnl, size_t off, size_t len);
+
+#endif /* JOURNAL_H */
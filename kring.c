@@ -0,0 +1,121 @@
+#include "kring.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *arena;
+static size_t cap;
+static size_t head;     // arena offset after the newest entry
+static struct kring_entry ents[KRING_MAX];
+static size_t first;    // index of the oldest entry
+static size_t num;
+
+static int reserve(size_t len);
+static int overlaps(size_t at, size_t len);
+static void drop_oldest(void);
+
+/*
+ * Text is copied straight from both sides of the gap, so a cut takes
+ * one copy of its bytes besides the gap move of the deletion itself.
+ */
+int kring_push(struct buffer const *buf, size_t off, size_t len)
+{
+	if (!len)
+		return SUCCESS;
+	if (reserve(len) != SUCCESS)
+		return ERROR;
+
+	size_t at = (head + len <= cap) ? head : 0;
+	while (num && (num == KRING_MAX || overlaps(at, len)))
+		drop_oldest();
+
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	size_t n = 0;
+	if (off < before_gap) {
+		n = before_gap - off < len ? before_gap - off : len;
+		memcpy(arena + at, buf->buf_b + off, n);
+	}
+	if (n < len) {
+		memcpy(arena + at + n, buf->gap_e + (off + n - before_gap),
+		       len - n);
+	}
+
+	ents[(first + num) % KRING_MAX] = (struct kring_entry){at, len};
+	num++;
+	head = at + len;
+
+	return SUCCESS;
+}
+
+char const * kring_get(size_t k, size_t *len)
+{
+	if (k >= num)
+		return NULL;
+
+	struct kring_entry const *e = &ents[(first + num - 1 - k) % KRING_MAX];
+	*len = e->len;
+	return arena + e->at;
+}
+
+size_t kring_num(void)
+{
+	return num;
+}
+
+void kring_free(void)
+{
+	free(arena);
+	arena = NULL;
+	cap = head = first = num = 0;
+}
+
+// arena is doubled up to budget while the entry doesn't fit after the
+// newest one, entries wrap to arena begin only when budget is reached.
+// Entry that is larger than budget takes the whole arena till next push.
+// Offsets of kept entries stay valid
+static int reserve(size_t len)
+{
+	size_t need = head + len;
+	if (len <= cap && (need <= cap || cap == KRING_BUDGET))
+		return SUCCESS;
+
+	size_t size = cap ? cap : KRING_ARENA_MIN;
+	while (size < need && size < KRING_BUDGET)
+		size *= 2;
+	if (size > KRING_BUDGET)
+		size = KRING_BUDGET;
+	if (size < len || cap > KRING_BUDGET) {
+		if (size < len)
+			size = len;
+		num = 0;
+		head = 0;
+	}
+
+	char *p = realloc(arena, size);
+	if (!p) {
+		log_ss("error", "kring reserve realloc fail");
+		return ERROR;
+	}
+	arena = p;
+	cap = size;
+
+	return SUCCESS;
+}
+
+static int overlaps(size_t at, size_t len)
+{
+	for (size_t i = 0; i < num; i++) {
+		struct kring_entry const *e = &ents[(first + i) % KRING_MAX];
+		if (e->at < at + len && at < e->at + e->len)
+			return 1;
+	}
+	return 0;
+}
+
+static void drop_oldest(void)
+{
+	first = (first + 1) % KRING_MAX;
+	num--;
+}
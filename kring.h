@@ -0,0 +1,34 @@
+#ifndef KRING_H
+#define KRING_H
+
+#include "buffer.h"
+
+#define KRING_MAX 32                // entries kept at most
+#define KRING_BUDGET (8 << 20)      // arena bytes, larger entry is kept alone
+#define KRING_ARENA_MIN 4096
+
+/*
+ * Kill ring of last copied and cut texts, shared by all buffers. Entries
+ * are kept one after another in one arena that is used as a ring: new
+ * entry is put after the newest one or at arena begin if it doesn't fit
+ * there, and the oldest entries it overlaps are dropped.
+ */
+struct kring_entry {
+	size_t at;      // offset in arena
+	size_t len;
+};
+
+// copy len bytes of text at offset to the ring as newest entry
+int kring_push(struct buffer const *buf, size_t off, size_t len);
+
+// k-th entry counting from the newest one, NULL if there is no such.
+// pointer is valid until next push
+char const * kring_get(size_t k, size_t *len);
+
+// number of entries
+size_t kring_num(void);
+
+// free the arena and drop all entries
+void kring_free(void);
+
+#endif /* KRING_H */
@@ -0,0 +1,632 @@
+#include "lindex.h"
+#include "buffer.h"
+#include "rc.h"
+#include "slog.h"
+#include "utf.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// logical range of text that is counted by one thread
+struct task {
+	size_t b;
+	size_t e;
+	size_t lines;
+	size_t symbols;
+	size_t line0;         // lines before the range
+};
+
+struct pool {
+	struct lindex *li;
+	struct task *tasks;
+	size_t num;
+	size_t threads;
+	int mark;             // second pass, checkpoints are written
+};
+
+struct worker {
+	struct pool *pool;
+	size_t id;
+};
+
+static void * build_thread(void *arg);
+static void build(struct lindex *li);
+static void run_pass(struct pool *pool);
+static void * worker(void *arg);
+static void count_task(struct lindex const *li, struct task *t);
+static void mark_task(struct lindex *li, struct task *t);
+static void count_text(char const *p, size_t len, size_t *lines,
+                       size_t *symbols);
+static void count_buf(struct buffer const *buf, size_t off, size_t len,
+                      size_t *lines, size_t *symbols);
+static size_t first_after(struct lindex const *li, size_t off);
+static int reserve(struct lindex *li, size_t num);
+static void add_points(struct buffer *buf, struct lindex *li, size_t i,
+                       size_t off, char const *src, size_t len);
+static void reset_tail(struct lindex *li);
+static size_t scan_lines(struct buffer const *buf, size_t b, size_t e,
+                         size_t *last_nl);
+static size_t line_begin(struct buffer const *buf, size_t b, size_t off);
+static size_t count_symbols(struct buffer const *buf, size_t b, size_t e);
+static void extend(struct buffer const *buf, struct lindex *li,
+                   size_t line, size_t off);
+
+int lindex_start(struct buffer *buf)
+{
+	lindex_stop(buf);
+
+	struct lindex *li = calloc(1, sizeof(struct lindex));
+	if (!li)
+		return ERROR;
+
+	if (reserve(li, 1) != SUCCESS) {
+		free(li);
+		return ERROR;
+	}
+	li->cp[0].off = 0;
+	li->cp[0].line = 0;
+	li->num = 1;
+
+	li->seg[0] = buf->buf_b;
+	li->seg_len[0] = buf->gap_b - buf->buf_b;
+	li->seg[1] = buf->gap_e;
+	li->seg_len[1] = buf->buf_e - buf->gap_e;
+	buf->lidx = li;
+
+	if (li->seg_len[0] + li->seg_len[1] < LINDEX_CHUNK ||
+	    pthread_create(&li->thread, NULL, build_thread, li)) {
+		build(li);
+		return SUCCESS;
+	}
+
+	li->building = 1;
+	return SUCCESS;
+}
+
+void lindex_wait(struct buffer const *buf)
+{
+	struct lindex *li = buf->lidx;
+	if (!li || !li->building)
+		return;
+
+	pthread_join(li->thread, NULL);
+	li->building = 0;
+}
+
+int lindex_ready(struct buffer const *buf)
+{
+	struct lindex *li = buf->lidx;
+	if (!li || !li->building)
+		return 1;
+
+	if (pthread_tryjoin_np(li->thread, NULL) != 0)
+		return 0;
+	li->building = 0;
+	return 1;
+}
+
+void lindex_stop(struct buffer *buf)
+{
+	if (!buf->lidx)
+		return;
+
+	lindex_wait(buf);
+	free(buf->lidx->cp);
+	free(buf->lidx);
+	buf->lidx = NULL;
+}
+
+/*
+ * Checkpoints after offset are shifted. If many lines are inserted,
+ * checkpoints are added for them too, so the table stays dense.
+ */
+void lindex_ins(struct buffer *buf, size_t off, char const *src,
+                size_t len)
+{
+	struct lindex *li = buf->lidx;
+	if (!li || !len)
+		return;
+
+	lindex_wait(buf);
+
+	size_t lines = 0;
+	size_t symbols = 0;
+	count_text(src, len, &lines, &symbols);
+	li->lines += lines;
+	li->symbols += symbols;
+
+	size_t last_off = li->cp[li->num - 1].off;
+	size_t i = first_after(li, off);
+	for (size_t j = i; j < li->num; j++) {
+		li->cp[j].off += len;
+		li->cp[j].line += lines;
+	}
+
+	if (off < li->tail_off) {
+		li->tail_off += len;
+		if (off >= last_off)
+			li->tail_lines += lines;
+	}
+
+	if (off < li->pos.off)
+		li->pos_valid = 0;
+
+	if (lines >= LINDEX_STEP)
+		add_points(buf, li, i, off, src, len);
+}
+
+void lindex_del(struct buffer *buf, size_t off, size_t len)
+{
+	struct lindex *li = buf->lidx;
+	if (!li || !len)
+		return;
+
+	lindex_wait(buf);
+
+	size_t lines = 0;
+	size_t symbols = 0;
+	count_buf(buf, off, len, &lines, &symbols);
+	li->lines -= lines;
+	li->symbols -= symbols;
+
+	/* usual backspace before cached position keeps it */
+	if (off + len == li->pos.off && !lines && li->pos_valid) {
+		li->pos.off = off;
+		li->pos_col -= symbols;
+	} else if (off < li->pos.off) {
+		li->pos_valid = 0;
+	}
+
+	/* lines that begin in deleted range are gone */
+	size_t last_off = li->cp[li->num - 1].off;
+	size_t i = first_after(li, off);
+	size_t k = first_after(li, off + len);
+	int last_gone = (k == li->num && k > i);
+	memmove(li->cp + i, li->cp + k, (li->num - k) * sizeof(struct lpoint));
+	li->num -= k - i;
+
+	for (size_t j = i; j < li->num; j++) {
+		li->cp[j].off -= len;
+		li->cp[j].line -= lines;
+	}
+
+	if (last_gone || (off < li->tail_off && off + len > li->tail_off)) {
+		reset_tail(li);
+	} else if (off < li->tail_off) {
+		li->tail_off -= len;
+		if (off >= last_off)
+			li->tail_lines -= lines;
+	}
+}
+
+size_t lindex_off_before(struct buffer const *buf, size_t off,
+                         size_t *line)
+{
+	struct lindex *li = buf->lidx;
+	*line = 0;
+	if (!li)
+		return 0;
+
+	lindex_wait(buf);
+	extend(buf, li, SIZE_MAX, off);
+
+	size_t i = first_after(li, off) - 1;
+	*line = li->cp[i].line;
+	return li->cp[i].off;
+}
+
+size_t lindex_line_before(struct buffer const *buf, size_t line,
+                          size_t *cp_line)
+{
+	struct lindex *li = buf->lidx;
+	*cp_line = 0;
+	if (!li)
+		return 0;
+
+	lindex_wait(buf);
+	extend(buf, li, line, SIZE_MAX);
+
+	size_t lo = 0;
+	size_t hi = li->num;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (li->cp[mid].line <= line)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	*cp_line = li->cp[lo].line;
+	return li->cp[lo].off;
+}
+
+/*
+ * Position is counted from previous one or from checkpoint, whichever
+ * is closer. Column is counted from line begin, if line was changed.
+ */
+void lindex_pos(struct buffer const *buf, size_t off, size_t *line,
+                size_t *col)
+{
+	struct lindex *li = buf->lidx;
+	*line = 0;
+	*col = 0;
+	if (!li)
+		return;
+
+	size_t cp_line;
+	size_t cp_off = lindex_off_before(buf, off, &cp_line);
+	size_t dist = off > li->pos.off ? off - li->pos.off : li->pos.off - off;
+	size_t nl;
+
+	if (!li->pos_valid || dist > off - cp_off) {
+		*line = cp_line + scan_lines(buf, cp_off, off, &nl);
+		*col = count_symbols(buf, nl == SIZE_MAX ? cp_off : nl + 1, off);
+	} else if (off >= li->pos.off) {
+		size_t n = scan_lines(buf, li->pos.off, off, &nl);
+		*line = li->pos.line + n;
+		if (n)
+			*col = count_symbols(buf, nl + 1, off);
+		else
+			*col = li->pos_col + count_symbols(buf, li->pos.off, off);
+	} else {
+		size_t n = scan_lines(buf, off, li->pos.off, &nl);
+		*line = li->pos.line - n;
+		if (n)
+			*col = count_symbols(buf, line_begin(buf, cp_off, off), off);
+		else
+			*col = li->pos_col - count_symbols(buf, off, li->pos.off);
+	}
+
+	li->pos.off = off;
+	li->pos.line = *line;
+	li->pos_col = *col;
+	li->pos_valid = 1;
+}
+
+static void * build_thread(void *arg)
+{
+	build(arg);
+	return NULL;
+}
+
+/*
+ * First pass counts lines and symbols in each chunk, then line number
+ * at the start of each chunk is known, so second pass writes offsets of
+ * checkpoints that are in the chunk. Chunks write different entries.
+ */
+static void build(struct lindex *li)
+{
+	size_t len = li->seg_len[0] + li->seg_len[1];
+	struct task one = { 0, len, 0, 0, 0 };
+	struct pool pool = { li, &one, 1, 1, 0 };
+
+	size_t num = len / LINDEX_CHUNK + 1;
+	struct task *tasks = NULL;
+	if (num > 1)
+		tasks = calloc(num, sizeof(struct task));
+	if (tasks) {
+		for (size_t i = 0; i < num; i++) {
+			tasks[i].b = i * LINDEX_CHUNK;
+			tasks[i].e = tasks[i].b + LINDEX_CHUNK;
+		}
+		tasks[num - 1].e = len;
+
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		pool.tasks = tasks;
+		pool.num = num;
+		pool.threads = (cpus > 0) ? cpus : 1;
+		if (pool.threads > LINDEX_THREADS_MAX)
+			pool.threads = LINDEX_THREADS_MAX;
+		if (pool.threads > num)
+			pool.threads = num;
+	}
+
+	run_pass(&pool);
+
+	size_t lines = 0;
+	for (size_t i = 0; i < pool.num; i++) {
+		pool.tasks[i].line0 = lines;
+		lines += pool.tasks[i].lines;
+		li->symbols += pool.tasks[i].symbols;
+	}
+	li->lines = lines;
+
+	size_t cp_num = lines / LINDEX_STEP + 1;
+	if (reserve(li, cp_num) == SUCCESS) {
+		pool.mark = 1;
+		run_pass(&pool);
+		li->num = cp_num;
+		li->tail_off = len;
+		li->tail_lines = lines % LINDEX_STEP;
+	} else {
+		log_ss("error", "lindex checkpoints alloc fail");
+	}
+
+	free(tasks);
+}
+
+// run tasks of the pass by threads of the pool and wait for them
+static void run_pass(struct pool *pool)
+{
+	struct worker workers[LINDEX_THREADS_MAX];
+	pthread_t threads[LINDEX_THREADS_MAX];
+	int started[LINDEX_THREADS_MAX];
+
+	for (size_t i = 0; i < pool->threads; i++) {
+		workers[i].pool = pool;
+		workers[i].id = i;
+		started[i] = (i && !pthread_create(&threads[i], NULL, worker,
+		                                   &workers[i]));
+	}
+
+	for (size_t i = 0; i < pool->threads; i++) {
+		if (!started[i])
+			worker(&workers[i]);
+	}
+
+	for (size_t i = 1; i < pool->threads; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+}
+
+static void * worker(void *arg)
+{
+	struct worker *w = arg;
+	struct pool *pool = w->pool;
+
+	for (size_t i = w->id; i < pool->num; i += pool->threads) {
+		if (pool->mark)
+			mark_task(pool->li, &pool->tasks[i]);
+		else
+			count_task(pool->li, &pool->tasks[i]);
+	}
+	return NULL;
+}
+
+static void count_task(struct lindex const *li, struct task *t)
+{
+	size_t seg_b = 0;
+	for (int i = 0; i < 2; i++) {
+		size_t seg_e = seg_b + li->seg_len[i];
+		size_t b = t->b > seg_b ? t->b : seg_b;
+		size_t e = t->e < seg_e ? t->e : seg_e;
+		if (b < e)
+			count_text(li->seg[i] + (b - seg_b), e - b, &t->lines,
+			           &t->symbols);
+		seg_b = seg_e;
+	}
+}
+
+static void mark_task(struct lindex *li, struct task *t)
+{
+	size_t line = t->line0;
+	size_t seg_b = 0;
+	for (int i = 0; i < 2; i++) {
+		size_t seg_e = seg_b + li->seg_len[i];
+		size_t b = t->b > seg_b ? t->b : seg_b;
+		size_t e = t->e < seg_e ? t->e : seg_e;
+		if (b >= e) {
+			seg_b = seg_e;
+			continue;
+		}
+
+		char const *p = li->seg[i] + (b - seg_b);
+		char const *end = li->seg[i] + (e - seg_b);
+		while (p < end && (p = memchr(p, '\n', end - p))) {
+			p++;
+			if (++line % LINDEX_STEP)
+				continue;
+			struct lpoint *cp = &li->cp[line / LINDEX_STEP];
+			cp->off = seg_b + (p - li->seg[i]);
+			cp->line = line;
+		}
+		seg_b = seg_e;
+	}
+}
+
+static void count_text(char const *p, size_t len, size_t *lines,
+                       size_t *symbols)
+{
+	char const *end = p + len;
+	char const *q = p;
+	while (q < end && (q = memchr(q, '\n', end - q))) {
+		(*lines)++;
+		q++;
+	}
+
+	size_t fill = 0;
+	for (char const *q = p; q < end; q++)
+		fill += ISFILL(*q);
+	*symbols += len - fill;
+}
+
+static void count_buf(struct buffer const *buf, size_t off, size_t len,
+                      size_t *lines, size_t *symbols)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	if (off < before_gap) {
+		size_t part = before_gap - off < len ? before_gap - off : len;
+		count_text(buf->buf_b + off, part, lines, symbols);
+		off += part;
+		len -= part;
+	}
+	if (len)
+		count_text(buf->gap_e + (off - before_gap), len, lines, symbols);
+}
+
+// index of first checkpoint after offset, cp[0] is never after it
+static size_t first_after(struct lindex const *li, size_t off)
+{
+	size_t lo = 1;
+	size_t hi = li->num;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (li->cp[mid].off <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int reserve(struct lindex *li, size_t num)
+{
+	if (num <= li->size)
+		return SUCCESS;
+
+	size_t size = li->size * 2;
+	if (size < num)
+		size = num;
+
+	struct lpoint *cp = realloc(li->cp, size * sizeof(struct lpoint));
+	if (!cp)
+		return ERROR;
+
+	li->cp = cp;
+	li->size = size;
+	return SUCCESS;
+}
+
+// put checkpoints for lines in src that is inserted at off before
+// checkpoint i, checkpoints after it are already shifted
+static void add_points(struct buffer *buf, struct lindex *li, size_t i,
+                       size_t off, char const *src, size_t len)
+{
+	size_t line = li->cp[i - 1].line;
+	size_t symbols = 0;
+	count_buf(buf, li->cp[i - 1].off, off - li->cp[i - 1].off, &line,
+	          &symbols);
+
+	size_t num = 0;
+	char const *end = src + len;
+	char const *p = src;
+	while ((p = memchr(p, '\n', end - p))) {
+		p++;
+		if (++num % LINDEX_STEP)
+			continue;
+		if (reserve(li, li->num + 1) != SUCCESS)
+			break;
+
+		memmove(li->cp + i + 1, li->cp + i,
+		        (li->num - i) * sizeof(struct lpoint));
+		li->cp[i].off = off + (p - src);
+		li->cp[i].line = line + num;
+		li->num++;
+		i++;
+	}
+
+	if (i == li->num)
+		reset_tail(li);
+}
+
+// text after last checkpoint should be scanned again
+static void reset_tail(struct lindex *li)
+{
+	li->tail_off = li->cp[li->num - 1].off;
+	li->tail_lines = 0;
+}
+
+/*
+ * Scan text after last checkpoint adding checkpoints, until there is
+ * one less than LINDEX_STEP lines before line or scan reaches offset.
+ */
+static void extend(struct buffer const *buf, struct lindex *li,
+                   size_t line, size_t off)
+{
+	size_t text_len = buf_len(buf);
+	if (off > text_len)
+		off = text_len;
+
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	while (li->tail_off < off &&
+	       li->cp[li->num - 1].line + LINDEX_STEP <= line) {
+		size_t pos = li->tail_off;
+		char const *p = buf->gap_e + (pos - before_gap);
+		size_t n = off - pos;
+		if (pos < before_gap) {
+			p = buf->buf_b + pos;
+			if (n > before_gap - pos)
+				n = before_gap - pos;
+		}
+
+		char const *nl = memchr(p, '\n', n);
+		if (!nl) {
+			li->tail_off += n;
+			continue;
+		}
+
+		li->tail_off += nl - p + 1;
+		if (++li->tail_lines < LINDEX_STEP)
+			continue;
+		if (reserve(li, li->num + 1) != SUCCESS)
+			return;
+
+		struct lpoint *last = &li->cp[li->num];
+		last->off = li->tail_off;
+		last->line = last[-1].line + LINDEX_STEP;
+		li->num++;
+		li->tail_lines = 0;
+	}
+}
+
+// number of newlines in [b, e), offset of the last one is set to
+// last_nl or SIZE_MAX if there are none
+static size_t scan_lines(struct buffer const *buf, size_t b, size_t e,
+                         size_t *last_nl)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	size_t n = 0;
+	*last_nl = SIZE_MAX;
+
+	while (b < e) {
+		char const *p = buf->gap_e + (b - before_gap);
+		size_t len = e - b;
+		if (b < before_gap) {
+			p = buf->buf_b + b;
+			if (len > before_gap - b)
+				len = before_gap - b;
+		}
+
+		char const *end = p + len;
+		char const *q = p;
+		while (q < end && (q = memchr(q, '\n', end - q))) {
+			n++;
+			*last_nl = b + (q - p);
+			q++;
+		}
+		b += len;
+	}
+	return n;
+}
+
+// begin of line with offset, b should be at or before that begin
+static size_t line_begin(struct buffer const *buf, size_t b, size_t off)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	if (off > before_gap) {
+		size_t seg_b = before_gap > b ? before_gap : b;
+		char const *p = buf->gap_e + (seg_b - before_gap);
+		char const *nl = memrchr(p, '\n', off - seg_b);
+		if (nl)
+			return seg_b + (nl - p) + 1;
+		off = seg_b;
+	}
+
+	if (off > b) {
+		char const *nl = memrchr(buf->buf_b + b, '\n', off - b);
+		if (nl)
+			return nl - buf->buf_b + 1;
+	}
+	return b;
+}
+
+static size_t count_symbols(struct buffer const *buf, size_t b, size_t e)
+{
+	size_t lines = 0;
+	size_t symbols = 0;
+	count_buf(buf, b, e - b, &lines, &symbols);
+	return symbols;
+}
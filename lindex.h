@@ -0,0 +1,90 @@
+#ifndef LINDEX_H
+#define LINDEX_H
+
+#include "buffer.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define LINDEX_STEP 4096                    // lines between checkpoints
+#define LINDEX_CHUNK (16 * 1024 * 1024)     // bytes counted by one task
+#define LINDEX_THREADS_MAX 16
+#define LINDEX_POLL_MS 100      // checks if background counting is done
+
+// begin of line that is known
+struct lpoint {
+	size_t off;
+	size_t line;
+};
+
+/*
+ * Line index of the text: sparse table of checkpoints, about one for
+ * LINDEX_STEP lines, and total counts of lines and symbols. It's built
+ * after the file is loaded by a pool of threads, each of them counts
+ * its own chunks of text. While it's built, the text can be displayed
+ * but not changed, functions that change the text or move it in memory
+ * wait for it.
+ *
+ * Edits shift checkpoints after them. Text that is added at the end
+ * (follow mode, stdin) is indexed when lines there are looked up.
+ *
+ * The index is a cache of the text, so lookups take a const buffer and
+ * still change the index: they join the finished thread, add
+ * checkpoints to the tail and keep the last position.
+ */
+struct lindex {
+	struct lpoint *cp;    // sorted checkpoints, cp[0] is begin of text
+	size_t num;
+	size_t size;          // allocated number of checkpoints
+	size_t tail_off;      // text after last checkpoint is scanned up to
+	size_t tail_lines;    // offset, it has that number of newlines
+	size_t lines;         // number of newlines in the text
+	size_t symbols;       // number of utf-8 symbols in the text
+	struct lpoint pos;    // last position that was looked up
+	size_t pos_col;
+	int pos_valid;
+	char const *seg[2];   // text parts that are being counted
+	size_t seg_len[2];
+	int building;         // thread is running and should be joined
+	pthread_t thread;
+};
+
+// count lines of loaded text, in background if text is large
+int lindex_start(struct buffer *buf);
+
+// wait until background counting is finished
+void lindex_wait(struct buffer const *buf);
+
+// 1 if counting is finished, thread that is done is joined without
+// waiting for others
+int lindex_ready(struct buffer const *buf);
+
+// wait for counting and free the index
+void lindex_stop(struct buffer *buf);
+
+// len bytes of src are inserted at offset, text before offset should
+// not be changed yet
+void lindex_ins(struct buffer *buf, size_t off, char const *src,
+                size_t len);
+
+// len bytes at offset are going to be deleted
+void lindex_del(struct buffer *buf, size_t off, size_t len);
+
+// offset of the last checkpoint at or before offset off, line number of
+// the checkpoint is set to line. 0 if there is no index. Checkpoints are
+// added up to off if it's in the tail
+size_t lindex_off_before(struct buffer const *buf, size_t off,
+                         size_t *line);
+
+// offset of the last checkpoint at or before line, its line number is
+// set to cp_line. 0 if there is no index. Checkpoints are added up to
+// line if it's in the tail
+size_t lindex_line_before(struct buffer const *buf, size_t line,
+                          size_t *cp_line);
+
+// line and column (both from 0, column in symbols) of offset. They are
+// found from previous position, so it's cheap when cursor moves a bit
+void lindex_pos(struct buffer const *buf, size_t off, size_t *line,
+                size_t *col);
+
+#endif /* LINDEX_H */
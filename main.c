@@ -1,19 +1,100 @@
+#include "batch.h"
 #include "edit.h"
+#include "rc.h"
+#include "util.h"
+#include "view.h"
+
+#include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static size_t split_num(char *fname);
 
 int main(int argc, char *argv[])
 {
+	char *script = NULL;
+	int view = 0;
+	size_t view_mem = VIEW_MEM_DEF;
+	int opt;
+	while ((opt = getopt(argc, argv, "e:vm:")) != -1) {
+		switch (opt) {
+		case 'e':
+			script = optarg;
+			break;
+		case 'v':
+			view = 1;
+			break;
+		case 'm':
+			view_mem = strtoull(optarg, NULL, 10) * 1024 * 1024;
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	char *fname = NULL;
-	if (argc > 1)
-		fname = argv[1];
+	size_t line = 0;
+	int col = 0;
+	if (optind < argc)
+		fname = argv[optind];
+
+	// FILE:LINE:COL or FILE:LINE, if there is no file with that name
+	if (!script && fname && !file_exists(fname)) {
+		size_t num = split_num(fname);
+		if (num) {
+			line = num;
+			num = split_num(fname);
+			if (num) {
+				col = line;
+				line = num;
+			}
+		}
+	}
+
+	if (script) {
+		int rc = batch_run(script, fname);
+		exit(rc ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	// file that can't be loaded is shown read-only
+	if (fname && file_exists(fname) && (view || view_wanted(fname))) {
+		int rc = view_run(fname, view_mem);
+		exit(rc ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
 
 	struct buffer *buf = edit_prepare(fname);
 	if (NULL == buf)
 		exit(EXIT_FAILURE);
 
+	for (int i = optind + 1; i < argc; i++) {
+		if (edit_add(argv[i]) != SUCCESS) {
+			edit_end(buf);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (line)
+		edit_goto(buf, line, col);
+
 	edit_run(buf);
 	edit_end(buf);
 
 	exit(EXIT_SUCCESS);
 }
 
+// cut :NUMBER from the end of fname, returns the number or 0
+static size_t split_num(char *fname)
+{
+	char *colon = strrchr(fname, ':');
+	if (!colon || colon == fname || !isdigit((unsigned char)colon[1]))
+		return 0;
+
+	for (char *p = colon + 1; *p; p++) {
+		if (!isdigit((unsigned char)*p))
+			return 0;
+	}
+
+	*colon = '\0';
+	return strtoull(colon + 1, NULL, 10);
+}
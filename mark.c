@@ -0,0 +1,227 @@
+#include "mark.h"
+
+#include <stdlib.h>
+
+static unsigned next_prio(struct mark_set *set);
+static void apply(struct mark *m, int has_set, size_t set_val, long add);
+static void push(struct mark *m);
+static void split(struct mark *t, size_t key, struct mark **l,
+                  struct mark **r);
+static struct mark * merge(struct mark *l, struct mark *r);
+static void insert(struct mark_set *set, struct mark *m);
+static void detach(struct mark_set *set, struct mark *m);
+static void free_tree(struct mark *t);
+
+struct mark_set * marks_create(void)
+{
+	struct mark_set *set = calloc(1, sizeof(struct mark_set));
+	if (!set)
+		return NULL;
+
+	set->seed = 2463534242u;
+	return set;
+}
+
+void marks_delete(struct mark_set *set)
+{
+	if (!set)
+		return;
+
+	free_tree(set->root);
+	free(set);
+}
+
+struct mark * mark_new(struct mark_set *set, size_t off)
+{
+	struct mark *m = calloc(1, sizeof(struct mark));
+	if (!m)
+		return NULL;
+
+	m->off = off;
+	m->prio = next_prio(set);
+	insert(set, m);
+	set->num++;
+
+	return m;
+}
+
+void mark_free(struct mark_set *set, struct mark *m)
+{
+	if (!m)
+		return;
+
+	detach(set, m);
+	set->num--;
+	free(m);
+}
+
+/*
+ * Pending tags of deeper nodes are older, so they are applied first.
+ */
+size_t mark_off(struct mark const *m)
+{
+	size_t off = m->off;
+	for (struct mark const *p = m->parent; p; p = p->parent) {
+		if (p->has_set)
+			off = p->set_val;
+		off += p->add;
+	}
+	return off;
+}
+
+void mark_move(struct mark_set *set, struct mark *m, size_t off)
+{
+	detach(set, m);
+	m->off = off;
+	insert(set, m);
+}
+
+void marks_ins(struct mark_set *set, size_t off, size_t len)
+{
+	if (!set || !set->root || !len)
+		return;
+
+	struct mark *l, *r;
+	split(set->root, off + 1, &l, &r);
+	apply(r, 0, 0, (long)len);
+	set->root = merge(l, r);
+	set->root->parent = NULL;
+}
+
+void marks_del(struct mark_set *set, size_t off, size_t len)
+{
+	if (!set || !set->root || !len)
+		return;
+
+	struct mark *l, *mid, *r;
+	split(set->root, off, &l, &r);
+	split(r, off + len, &mid, &r);
+	apply(mid, 1, off, 0);
+	apply(r, 0, 0, -(long)len);
+	set->root = merge(merge(l, mid), r);
+	set->root->parent = NULL;
+}
+
+static unsigned next_prio(struct mark_set *set)
+{
+	unsigned x = set->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	set->seed = x;
+	return x;
+}
+
+static void apply(struct mark *m, int has_set, size_t set_val, long add)
+{
+	if (!m)
+		return;
+
+	if (has_set) {
+		m->off = set_val;
+		m->has_set = 1;
+		m->set_val = set_val;
+		m->add = 0;
+	}
+
+	m->off += add;
+	if (m->has_set)
+		m->set_val += add;
+	else
+		m->add += add;
+}
+
+static void push(struct mark *m)
+{
+	if (!m->has_set && !m->add)
+		return;
+
+	apply(m->left, m->has_set, m->set_val, m->add);
+	apply(m->right, m->has_set, m->set_val, m->add);
+	m->has_set = 0;
+	m->add = 0;
+}
+
+// l gets marks with offsets less than key
+static void split(struct mark *t, size_t key, struct mark **l,
+                  struct mark **r)
+{
+	if (!t) {
+		*l = *r = NULL;
+		return;
+	}
+
+	push(t);
+	if (t->off < key) {
+		split(t->right, key, &t->right, r);
+		if (t->right)
+			t->right->parent = t;
+		*l = t;
+	} else {
+		split(t->left, key, l, &t->left);
+		if (t->left)
+			t->left->parent = t;
+		*r = t;
+	}
+	t->parent = NULL;
+}
+
+static struct mark * merge(struct mark *l, struct mark *r)
+{
+	if (!l)
+		return r;
+	if (!r)
+		return l;
+
+	if (l->prio > r->prio) {
+		push(l);
+		l->right = merge(l->right, r);
+		l->right->parent = l;
+		return l;
+	}
+
+	push(r);
+	r->left = merge(l, r->left);
+	r->left->parent = r;
+	return r;
+}
+
+static void insert(struct mark_set *set, struct mark *m)
+{
+	struct mark *l, *r;
+	m->left = m->right = m->parent = NULL;
+	m->has_set = 0;
+	m->add = 0;
+
+	split(set->root, m->off, &l, &r);
+	set->root = merge(merge(l, m), r);
+	set->root->parent = NULL;
+}
+
+static void detach(struct mark_set *set, struct mark *m)
+{
+	push(m);
+	struct mark *sub = merge(m->left, m->right);
+	struct mark *parent = m->parent;
+	if (sub)
+		sub->parent = parent;
+
+	if (!parent)
+		set->root = sub;
+	else if (parent->left == m)
+		parent->left = sub;
+	else
+		parent->right = sub;
+
+	m->left = m->right = m->parent = NULL;
+}
+
+static void free_tree(struct mark *t)
+{
+	if (!t)
+		return;
+
+	free_tree(t->left);
+	free_tree(t->right);
+	free(t);
+}
@@ -0,0 +1,55 @@
+#ifndef MARK_H
+#define MARK_H
+
+#include <stddef.h>
+
+/*
+ * Marks are logical text offsets that stay valid when text is changed
+ * or buffer memory is moved. They are kept in treap ordered by offset,
+ * shifting of all marks after edit point is stored as pending tag in
+ * one node, so any edit costs O(log n) for any number of marks.
+ *
+ * Mark stays before text inserted at its offset, marks inside deleted
+ * range are moved to its begin.
+ */
+struct mark {
+	size_t off;
+	struct mark *left;
+	struct mark *right;
+	struct mark *parent;
+	unsigned prio;
+	long add;         // pending shift for children
+	int has_set;      // pending assignment of set_val for children
+	size_t set_val;
+};
+
+struct mark_set {
+	struct mark *root;
+	size_t num;
+	unsigned seed;
+};
+
+struct mark_set * marks_create(void);
+
+// frees set and all its marks
+void marks_delete(struct mark_set *set);
+
+// add mark at offset, returns NULL if there is no memory
+struct mark * mark_new(struct mark_set *set, size_t off);
+
+// remove mark from set and free it
+void mark_free(struct mark_set *set, struct mark *m);
+
+// current offset of mark
+size_t mark_off(struct mark const *m);
+
+// move mark to other offset
+void mark_move(struct mark_set *set, struct mark *m, size_t off);
+
+// len bytes were inserted at offset
+void marks_ins(struct mark_set *set, size_t off, size_t len);
+
+// len bytes were deleted at offset
+void marks_del(struct mark_set *set, size_t off, size_t len);
+
+#endif /* MARK_H */
@@ -0,0 +1,252 @@
+#include "mcursor.h"
+#include "buffer.h"
+#include "rc.h"
+#include "util.h"
+#include "utf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MC_INIT_SIZE 16
+
+static int reserve(struct buffer *buf, size_t num);
+static char byte_at(struct buffer const *buf, size_t off);
+static size_t merge_main(struct buffer *buf);
+static void split_main(struct buffer *buf, size_t idx);
+
+int mc_add(struct buffer *buf, size_t off)
+{
+	mc_check(buf);
+	if (off == ptr_to_off(buf, buf->cursor))
+		return SUCCESS;
+
+	size_t num = buf->mc ? buf->mc->num : 0;
+	if (reserve(buf, num + 2) != SUCCESS)
+		return ERROR;
+
+	struct mcursor *mc = buf->mc;
+	size_t i = mc_first_from(mc, off);
+	if (i < mc->num && mc->off[i] == off)
+		return SUCCESS;
+
+	memmove(mc->off + i + 1, mc->off + i, (mc->num - i) * sizeof(size_t));
+	mc->off[i] = off;
+	mc->num++;
+	mc->changes = buf->changes;
+	return SUCCESS;
+}
+
+void mc_clear(struct buffer *buf)
+{
+	if (!buf->mc)
+		return;
+
+	free(buf->mc->off);
+	free(buf->mc->lens);
+	free(buf->mc);
+	buf->mc = NULL;
+}
+
+/*
+ * Only edits done through the cursors shift their offsets. Any other
+ * one (deletion of selection, paste, reload) leaves them pointing at
+ * the old text, possibly past its end.
+ */
+void mc_check(struct buffer *buf)
+{
+	if (buf->mc && buf->mc->changes != buf->changes)
+		mc_clear(buf);
+}
+
+int mc_add_next_match(struct buffer *buf)
+{
+	if (!buf->sel)
+		return ERROR;
+	mc_check(buf);
+
+	size_t sel_b = ptr_to_off(buf, buf->sel);
+	size_t sel_e = ptr_to_off(buf, buf->cursor);
+	if (sel_b > sel_e) {
+		size_t tmp = sel_b;
+		sel_b = sel_e;
+		sel_e = tmp;
+	}
+
+	size_t len = sel_e - sel_b;
+	if (!len || len > FIND_MAX)
+		return ERROR;
+
+	char pat[FIND_MAX];
+	for (size_t i = 0; i < len; i++)
+		pat[i] = byte_at(buf, sel_b + i);
+
+	size_t from = sel_e;
+	if (buf->mc && buf->mc->num && buf->mc->off[buf->mc->num - 1] > from)
+		from = buf->mc->off[buf->mc->num - 1];
+
+	long off = find_bytes(buf, from, pat, len);
+	if (off < 0)
+		return ERROR;
+
+	return mc_add(buf, off + len);
+}
+
+int mc_add_sel_lines(struct buffer *buf)
+{
+	if (!buf->sel)
+		return ERROR;
+
+	size_t sel_b = ptr_to_off(buf, buf->sel);
+	size_t sel_e = ptr_to_off(buf, buf->cursor);
+	if (sel_b > sel_e) {
+		size_t tmp = sel_b;
+		sel_b = sel_e;
+		sel_e = tmp;
+	}
+
+	size_t line_b = sel_b;
+	while (line_b && byte_at(buf, line_b - 1) != '\n')
+		line_b--;
+
+	while (line_b <= sel_e) {
+		if (mc_add(buf, line_b) != SUCCESS)
+			return ERROR;
+
+		long nl = find_bytes(buf, line_b, "\n", 1);
+		if (nl < 0)
+			break;
+		line_b = nl + 1;
+	}
+
+	buf->sel = NULL;
+	return SUCCESS;
+}
+
+size_t mc_first_from(struct mcursor const *mc, size_t off)
+{
+	size_t lo = 0;
+	size_t hi = mc->num;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (mc->off[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int mc_insert(struct buffer *buf, char const *src, size_t len)
+{
+	size_t idx = merge_main(buf);
+	struct mcursor *mc = buf->mc;
+	int ret = insert_multi(buf, mc->off, mc->num, src, len);
+	split_main(buf, idx);
+	mc->changes = buf->changes;
+
+	return ret;
+}
+
+void mc_del(struct buffer *buf, int prev)
+{
+	size_t idx = merge_main(buf);
+	struct mcursor *mc = buf->mc;
+	size_t text_len = buf_len(buf);
+
+	for (size_t i = 0; i < mc->num; i++) {
+		size_t off = mc->off[i];
+		size_t limit;
+
+		if (prev) {
+			limit = i ? mc->off[i - 1] : 0;
+			size_t start = off;
+			if (start > limit)
+				start--;
+			while (start > limit && ISFILL(byte_at(buf, start)))
+				start--;
+			mc->lens[i] = off - start;
+			mc->off[i] = start;
+		} else {
+			limit = i + 1 < mc->num ? mc->off[i + 1] : text_len;
+			size_t len = 0;
+			if (off < limit)
+				len = get_symb_len(byte_at(buf, off));
+			if (off + len > limit)
+				len = limit - off;
+			mc->lens[i] = len;
+		}
+	}
+
+	delete_multi(buf, mc->off, mc->lens, mc->num);
+	split_main(buf, idx);
+	mc->changes = buf->changes;
+}
+
+static int reserve(struct buffer *buf, size_t num)
+{
+	if (!buf->mc) {
+		buf->mc = calloc(1, sizeof(struct mcursor));
+		if (!buf->mc)
+			return ERROR;
+	}
+
+	struct mcursor *mc = buf->mc;
+	if (num <= mc->size)
+		return SUCCESS;
+
+	size_t size = mc->size ? mc->size * 2 : MC_INIT_SIZE;
+	if (size < num)
+		size = num;
+
+	size_t *off = realloc(mc->off, size * sizeof(size_t));
+	if (!off)
+		return ERROR;
+	mc->off = off;
+
+	size_t *lens = realloc(mc->lens, size * sizeof(size_t));
+	if (!lens)
+		return ERROR;
+	mc->lens = lens;
+
+	mc->size = size;
+	return SUCCESS;
+}
+
+static char byte_at(struct buffer const *buf, size_t off)
+{
+	return *off_to_ptr(buf, off);
+}
+
+// put main cursor to the list of cursors, returns its index
+static size_t merge_main(struct buffer *buf)
+{
+	struct mcursor *mc = buf->mc;
+	size_t off = ptr_to_off(buf, buf->cursor);
+	size_t i = mc_first_from(mc, off);
+
+	if (i == mc->num || mc->off[i] != off) {
+		memmove(mc->off + i + 1, mc->off + i,
+		        (mc->num - i) * sizeof(size_t));
+		mc->off[i] = off;
+		mc->num++;
+	}
+	return i;
+}
+
+// take main cursor from the list, drop cursors that became the same
+static void split_main(struct buffer *buf, size_t idx)
+{
+	struct mcursor *mc = buf->mc;
+	size_t main_off = mc->off[idx];
+	buf->cursor = off_to_ptr(buf, main_off);
+
+	size_t n = 0;
+	for (size_t i = 0; i < mc->num; i++) {
+		if (mc->off[i] == main_off)
+			continue;
+		if (n && mc->off[n - 1] == mc->off[i])
+			continue;
+		mc->off[n++] = mc->off[i];
+	}
+	mc->num = n;
+}
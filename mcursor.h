@@ -0,0 +1,43 @@
+#ifndef MCURSOR_H
+#define MCURSOR_H
+
+#include "buffer.h"
+
+/*
+ * Additional cursors. They are kept as sorted text offsets and every
+ * edit is applied to all of them (and to main cursor) in one pass.
+ */
+struct mcursor {
+	size_t *off;     // sorted offsets of additional cursors
+	size_t num;
+	size_t size;     // allocated number of offsets
+	size_t *lens;    // scratch space for deletions
+	size_t changes;  // buf->changes after the last edit through cursors
+};
+
+// add cursor at offset, returns ERROR if there is no memory
+int mc_add(struct buffer *buf, size_t off);
+
+// remove all additional cursors
+void mc_clear(struct buffer *buf);
+
+// drop cursors if text was changed by other edits, their offsets are
+// stale then
+void mc_check(struct buffer *buf);
+
+// add cursor after next occurrence of selected text
+int mc_add_next_match(struct buffer *buf);
+
+// add cursor at begin of each selected line
+int mc_add_sel_lines(struct buffer *buf);
+
+// index of first cursor with offset not less than off
+size_t mc_first_from(struct mcursor const *mc, size_t off);
+
+// insert bytes at every cursor
+int mc_insert(struct buffer *buf, char const *src, size_t len);
+
+// delete symbol before (if prev is not 0) or at every cursor
+void mc_del(struct buffer *buf, int prev);
+
+#endif /* MCURSOR_H */
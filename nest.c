@@ -0,0 +1,335 @@
+#include "nest.h"
+#include "buffer.h"
+#include "rc.h"
+#include "slog.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// type of bracket from 1, negative for closing ones
+static signed char const kind[256] = {
+	['('] = 1, [')'] = -1,
+	['['] = 2, [']'] = -2,
+	['{'] = 3, ['}'] = -3,
+};
+
+static size_t block_of(struct nest const *n, size_t off);
+static size_t block_end(struct buffer const *buf, struct nest const *n,
+                        size_t i);
+static size_t block_at(struct buffer const *buf, struct nest *n,
+                       size_t off);
+static int clean(struct buffer const *buf, struct nest *n, size_t i);
+static void count(char const *p, size_t len, long *depth, long *min);
+static void count_buf(struct buffer const *buf, size_t b, size_t e,
+                      long *depth, long *min);
+static long find_close(struct buffer const *buf, size_t b, size_t e,
+                       int t, long depth, long target);
+static long find_open(struct buffer const *buf, size_t b, size_t e,
+                      int t, long depth, long target);
+static char const * seg(struct buffer const *buf, size_t b, size_t e,
+                        size_t *len);
+static int reserve(struct nest *n, size_t num);
+
+int nest_start(struct buffer *buf)
+{
+	nest_stop(buf);
+
+	struct nest *n = calloc(1, sizeof(struct nest));
+	if (!n)
+		return ERROR;
+	if (reserve(n, 1) != SUCCESS) {
+		free(n);
+		return ERROR;
+	}
+
+	memset(&n->cp[0], 0, sizeof(struct npoint));
+	n->cp[0].dirty = 1;
+	n->num = 1;
+	buf->nest = n;
+	return SUCCESS;
+}
+
+void nest_stop(struct buffer *buf)
+{
+	if (!buf->nest)
+		return;
+
+	free(buf->nest->cp);
+	free(buf->nest);
+	buf->nest = NULL;
+}
+
+void nest_ins(struct buffer *buf, size_t off, char const *src, size_t len)
+{
+	struct nest *n = buf->nest;
+	if (!n || !len)
+		return;
+
+	long bal[NEST_TYPES] = {0};
+	long low[NEST_TYPES] = {0};
+	count(src, len, bal, low);
+
+	size_t i = block_of(n, off);
+	n->cp[i].dirty = 1;
+	for (size_t j = i + 1; j < n->num; j++) {
+		n->cp[j].off += len;
+		for (int t = 0; t < NEST_TYPES; t++) {
+			n->cp[j].depth[t] += bal[t];
+			n->cp[j].min[t] += bal[t];
+		}
+	}
+}
+
+// blocks that begin in deleted range are joined to the one before it
+void nest_del(struct buffer *buf, size_t off, size_t len)
+{
+	struct nest *n = buf->nest;
+	size_t text_len = buf_len(buf);
+	if (!n || !len || off >= text_len)
+		return;
+	if (len > text_len - off)
+		len = text_len - off;
+
+	long bal[NEST_TYPES] = {0};
+	long low[NEST_TYPES] = {0};
+	count_buf(buf, off, off + len, bal, low);
+
+	size_t i = block_of(n, off);
+	size_t k = block_of(n, off + len) + 1;
+	if (k <= i)
+		k = i + 1;
+	memmove(n->cp + i + 1, n->cp + k,
+	        (n->num - k) * sizeof(struct npoint));
+	n->num -= k - i - 1;
+
+	n->cp[i].dirty = 1;
+	for (size_t j = i + 1; j < n->num; j++) {
+		n->cp[j].off -= len;
+		for (int t = 0; t < NEST_TYPES; t++) {
+			n->cp[j].depth[t] -= bal[t];
+			n->cp[j].min[t] -= bal[t];
+		}
+	}
+}
+
+long nest_match(struct buffer *buf, size_t off)
+{
+	struct nest *n = buf->nest;
+	if (!n || off >= buf_len(buf))
+		return -1;
+
+	int k = kind[(unsigned char)*off_to_ptr(buf, off)];
+	if (!k)
+		return -1;
+	int t = (k > 0 ? k : -k) - 1;
+
+	size_t i = block_at(buf, n, off);
+	if (i == SIZE_MAX)
+		return -1;
+
+	long depth[NEST_TYPES], min[NEST_TYPES];
+	memcpy(depth, n->cp[i].depth, sizeof(depth));
+	memcpy(min, depth, sizeof(min));
+	count_buf(buf, n->cp[i].off, off, depth, min);
+	long d = depth[t];
+
+	if (k > 0) {
+		long m = find_close(buf, off + 1, block_end(buf, n, i), t,
+		                    d + 1, d);
+		for (size_t j = i + 1; m < 0 && j < n->num; j++) {
+			if (clean(buf, n, j) != SUCCESS)
+				return -1;
+			if (n->cp[j].min[t] <= d)
+				m = find_close(buf, n->cp[j].off,
+				               block_end(buf, n, j), t,
+				               n->cp[j].depth[t], d);
+		}
+		return m;
+	}
+
+	// block before the scanned range could be joined with it when it's
+	// cleaned, so the range end and depth there are kept aside
+	long m = find_open(buf, n->cp[i].off, off, t, d, d - 1);
+	size_t e = n->cp[i].off;
+	long e_depth = n->cp[i].depth[t];
+	while (m < 0 && e) {
+		size_t j = block_at(buf, n, e - 1);
+		if (j == SIZE_MAX)
+			return -1;
+		if (n->cp[j].min[t] <= d - 1)
+			m = find_open(buf, n->cp[j].off, e, t, e_depth, d - 1);
+		e = n->cp[j].off;
+		e_depth = n->cp[j].depth[t];
+	}
+	return m;
+}
+
+// last block that begins at offset or before it
+static size_t block_of(struct nest const *n, size_t off)
+{
+	size_t lo = 0;
+	size_t hi = n->num;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (n->cp[mid].off <= off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static size_t block_end(struct buffer const *buf, struct nest const *n,
+                        size_t i)
+{
+	return i + 1 < n->num ? n->cp[i + 1].off : buf_len(buf);
+}
+
+// clean block with offset, SIZE_MAX if there is no memory to split it
+static size_t block_at(struct buffer const *buf, struct nest *n,
+                       size_t off)
+{
+	size_t i = block_of(n, off);
+	while (n->cp[i].dirty) {
+		if (clean(buf, n, i) != SUCCESS)
+			return SIZE_MAX;
+		i = block_of(n, off);
+	}
+	return i;
+}
+
+/*
+ * Short block is joined with the next one. Long one is split: only its
+ * first NEST_STEP bytes are scanned, the rest is left as a dirty block
+ * with depth at its begin.
+ */
+static int clean(struct buffer const *buf, struct nest *n, size_t i)
+{
+	struct npoint *cp = &n->cp[i];
+	if (!cp->dirty)
+		return SUCCESS;
+
+	if (i + 1 < n->num && block_end(buf, n, i + 1) - cp->off <= NEST_STEP) {
+		memmove(cp + 1, cp + 2,
+		        (n->num - i - 2) * sizeof(struct npoint));
+		n->num--;
+	}
+
+	size_t e = block_end(buf, n, i);
+	if (e - cp->off > 2 * NEST_STEP) {
+		if (reserve(n, n->num + 1) != SUCCESS) {
+			log_ss("error", "nest checkpoints alloc fail");
+			return ERROR;
+		}
+		cp = &n->cp[i];
+		memmove(cp + 2, cp + 1,
+		        (n->num - i - 1) * sizeof(struct npoint));
+		n->num++;
+		e = cp->off + NEST_STEP;
+		cp[1].off = e;
+		cp[1].dirty = 1;
+	}
+
+	long depth[NEST_TYPES];
+	memcpy(depth, cp->depth, sizeof(depth));
+	memcpy(cp->min, cp->depth, sizeof(depth));
+	count_buf(buf, cp->off, e, depth, cp->min);
+	if (i + 1 < n->num && n->cp[i + 1].off == e)
+		memcpy(n->cp[i + 1].depth, depth, sizeof(depth));
+	cp->dirty = 0;
+	return SUCCESS;
+}
+
+static void count(char const *p, size_t len, long *depth, long *min)
+{
+	for (size_t i = 0; i < len; i++) {
+		int k = kind[(unsigned char)p[i]];
+		if (k > 0) {
+			depth[k - 1]++;
+		} else if (k < 0 && --depth[-k - 1] < min[-k - 1]) {
+			min[-k - 1] = depth[-k - 1];
+		}
+	}
+}
+
+static void count_buf(struct buffer const *buf, size_t b, size_t e,
+                      long *depth, long *min)
+{
+	while (b < e) {
+		size_t len;
+		char const *p = seg(buf, b, e, &len);
+		count(p, len, depth, min);
+		b += len;
+	}
+}
+
+// first closing bracket in [b, e) where depth falls to target
+static long find_close(struct buffer const *buf, size_t b, size_t e,
+                       int t, long depth, long target)
+{
+	while (b < e) {
+		size_t len;
+		char const *p = seg(buf, b, e, &len);
+		for (size_t i = 0; i < len; i++) {
+			int k = kind[(unsigned char)p[i]];
+			if (k == t + 1)
+				depth++;
+			else if (k == -t - 1 && --depth == target)
+				return b + i;
+		}
+		b += len;
+	}
+	return -1;
+}
+
+// last opening bracket in [b, e) where depth before it is target, depth
+// at e is given
+static long find_open(struct buffer const *buf, size_t b, size_t e,
+                      int t, long depth, long target)
+{
+	while (e > b) {
+		size_t before_gap = buf->gap_b - buf->buf_b;
+		size_t from = (e > before_gap && b < before_gap) ? before_gap : b;
+		char const *p = off_to_ptr(buf, from);
+		for (size_t i = e - from; i-- > 0; ) {
+			int k = kind[(unsigned char)p[i]];
+			if (k == -t - 1)
+				depth++;
+			else if (k == t + 1 && --depth == target)
+				return from + i;
+		}
+		e = from;
+	}
+	return -1;
+}
+
+// contiguous bytes of text from offset b, not more than to e
+static char const * seg(struct buffer const *buf, size_t b, size_t e,
+                        size_t *len)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	if (b < before_gap) {
+		*len = (e < before_gap ? e : before_gap) - b;
+		return buf->buf_b + b;
+	}
+	*len = e - b;
+	return buf->gap_e + (b - before_gap);
+}
+
+static int reserve(struct nest *n, size_t num)
+{
+	if (num <= n->size)
+		return SUCCESS;
+
+	size_t size = n->size ? n->size * 2 : 64;
+	while (size < num)
+		size *= 2;
+
+	struct npoint *p = realloc(n->cp, size * sizeof(struct npoint));
+	if (!p)
+		return ERROR;
+	n->cp = p;
+	n->size = size;
+	return SUCCESS;
+}
@@ -0,0 +1,53 @@
+#ifndef NEST_H
+#define NEST_H
+
+#include "buffer.h"
+
+#include <stddef.h>
+
+#define NEST_STEP (64 * 1024)   // bytes between checkpoints
+#define NEST_TYPES 3            // (), [] and {}
+
+// begin of block of text with nesting depth of each bracket type there
+struct npoint {
+	size_t off;
+	long depth[NEST_TYPES];
+	long min[NEST_TYPES];   // lowest depth in block, its ends included
+	int dirty;              // min isn't known, block is scanned again
+};
+
+/*
+ * Nesting depth checkpoints, about one for NEST_STEP bytes. Depth of
+ * each bracket type is counted separately, brackets in strings and
+ * comments are counted too.
+ *
+ * An edit makes only the block it's in dirty, blocks after it are
+ * shifted by its length and depths there by its brackets balance.
+ * Dirty blocks are scanned when they are needed, a long one is split on
+ * the way, so the text is first cut into blocks only as far as it's
+ * looked at. Search of a match skips blocks whose lowest depth doesn't
+ * reach the one of the match and scans only the block where it is.
+ */
+struct nest {
+	struct npoint *cp;      // sorted checkpoints, cp[0] is begin of text
+	size_t num;
+	size_t size;            // allocated number of checkpoints
+};
+
+// begin tracking depth of loaded text
+int nest_start(struct buffer *buf);
+
+// free the checkpoints
+void nest_stop(struct buffer *buf);
+
+// len bytes of src are going to be inserted at offset
+void nest_ins(struct buffer *buf, size_t off, char const *src, size_t len);
+
+// len bytes at offset are going to be deleted
+void nest_del(struct buffer *buf, size_t off, size_t len);
+
+// offset of bracket that matches one at offset off, -1 if there is no
+// bracket at off or it has no match
+long nest_match(struct buffer *buf, size_t off);
+
+#endif /* NEST_H */
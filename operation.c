@@ -1,4 +1,6 @@
 #include "buffer.h"
+#include "kring.h"
+#include "lindex.h"
 #include "operation.h"
 #include "slog.h"
 #include "rc.h"
@@ -8,6 +10,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 static char * 
@@ -23,7 +26,6 @@ static char * ptr_to_line_next(struct buffer const *buf, char const *pos);
 static char * ptr_to_line_prev(struct buffer const *buf, char const *pos);
 static int pos_in_line(struct buffer const *buf, char const *p);
 static int this_line_len(struct buffer const *buf, char const *p); 
-static void del_ch(struct buffer *buf);
 
 int mv_cursor(struct buffer *buf, int const direction)
 {
@@ -74,6 +76,7 @@ int add_ch(struct buffer *buf, char ch)
 	}
 
 	move_gap(buf);
+	text_ins(buf, buf->gap_b - buf->buf_b, &ch, 1);
 	*buf->gap_b = ch;
 	buf->gap_b++;
 
@@ -87,8 +90,10 @@ void del_symb(struct buffer *buf)
 	int bytes = get_symb_len(*buf->cursor);
 
 	if (buf->gap_e + bytes <= buf->buf_e) {
+		text_del(buf, buf->gap_b - buf->buf_b, bytes);
 		buf->gap_e += bytes;
 		buf->cursor += bytes;
+		reclaim_gap(buf);
 	}
 }
 
@@ -101,63 +106,36 @@ void del_prev_symb(struct buffer *buf)
 		return;
 
 	int num_chars = get_symb_len(*prev_pos);
+	text_del(buf, prev_pos - buf->buf_b, num_chars);
 	buf->gap_b -= num_chars;
+	reclaim_gap(buf);
 }
 
-int copy_sel(struct buffer *buf)
+size_t copy_sel(struct buffer *buf)
 {
-	free_copy_buf(buf);
 	if (!buf->sel)
 		return 0;
 
-	char *sel_b = buf->sel;
-	char *sel_e = buf->cursor;
-	if (buf->sel > buf->cursor) {
-		sel_b = buf->cursor;
-		sel_e = buf->sel;
-	}
-
-	int gap_b_sel = (sel_b <= buf->gap_b && buf->gap_b <= sel_e);
-	int gap_e_sel = (sel_b <= buf->gap_e && buf->gap_e <= sel_e);
-	int skip_gap_size = 0;
-
-	if (gap_b_sel && gap_e_sel) {
-		skip_gap_size = buf->gap_e - buf->gap_b;
-	} else if (gap_b_sel) {
-		skip_gap_size = sel_e - buf->gap_b;
-	} else if (gap_e_sel) {
-		skip_gap_size = buf->gap_e - sel_b;
+	size_t off_b = ptr_to_off(buf, buf->sel);
+	size_t off_e = ptr_to_off(buf, buf->cursor);
+	if (off_b > off_e) {
+		size_t off = off_b;
+		off_b = off_e;
+		off_e = off;
 	}
 
-	int buf_size = sel_e - sel_b - skip_gap_size;
-	if (buf_size <= 0)
-		return 0;
-
-	char *buf_p = calloc(buf_size, sizeof(char));
-	if (!buf_p)
+	if (kring_push(buf, off_b, off_e - off_b) != SUCCESS)
 		return 0;
-
-	buf->copy_buf = buf_p;
-	buf->copy_buf_size = buf_size; 
-
-	int i = 0;
-	char *p = sel_b;
-	for (i = 0; i < buf_size && p <= sel_e; i++, p++) {
-		if (in_gap(buf, p) && buf->gap_e < sel_e)
-			p = buf->gap_e;
-		buf->copy_buf[i] = *p;
-	}
-
-	return i;
+	return off_e - off_b;
 }
 
-int paste(struct buffer *buf)
+int paste(struct buffer *buf, size_t k, size_t *len)
 {
-	bool ok = true;
-	for (size_t i = 0; i < buf->copy_buf_size && ok; i++)
-		ok = (add_ch(buf, buf->copy_buf[i]) == SUCCESS);
+	char const *src = kring_get(k, len);
+	if (!src)
+		return ERROR;
 
-	return (ok ? SUCCESS : ERROR);
+	return insert_bytes(buf, ptr_to_off(buf, buf->cursor), src, *len);
 }
 
 void del_sel(struct buffer *buf)
@@ -172,12 +150,9 @@ void del_sel(struct buffer *buf)
 		sel_e = buf->sel;
 	}
 
+	size_t off = ptr_to_off(buf, sel_b);
 	buf->cursor = sel_b;
-	move_gap(buf);
-
-	int bytes = sel_e - sel_b;
-	while (bytes-- > 0)
-		del_ch(buf);
+	delete_bytes(buf, off, ptr_to_off(buf, sel_e) - off);
 }
 
 void mv_by_lines(struct buffer *buf, int lines_num, int direction)
@@ -202,6 +177,95 @@ void mv_by_lines(struct buffer *buf, int lines_num, int direction)
 	}
 }
 
+void mv_to_end(struct buffer *buf, int lines_num)
+{
+	buf->cursor = off_to_ptr(buf, buf_len(buf));
+
+	char *p = prev_symb(buf, buf->cursor);
+	if (p == buf->cursor) {
+		buf->disp_b = buf->cursor;
+		return;
+	}
+
+	p = ptr_to_line_b(buf, p);
+	for (int i = 2; i < lines_num; i++) {
+		char *prev = prev_symb(buf, p);
+		if (prev == p)
+			break;
+		p = ptr_to_line_b(buf, prev);
+	}
+	buf->disp_b = p;
+}
+
+size_t line_num(struct buffer const *buf, char const *pos)
+{
+	size_t ret;
+	size_t from = lindex_off_before(buf, ptr_to_off(buf, pos), &ret);
+	char const *b = off_to_ptr(buf, from);
+	char const *segs[2][2] = {
+		{ b, pos < buf->gap_b ? pos : buf->gap_b },
+		{ b < buf->gap_b ? buf->gap_e : b, pos }
+	};
+
+	for (int i = 0; i < 2; i++) {
+		char const *p = segs[i][0];
+		char const *e = segs[i][1];
+		while (p < e && (p = memchr(p, '\n', e - p))) {
+			ret++;
+			p++;
+		}
+	}
+
+	return ret;
+}
+
+int col_num(struct buffer const *buf, char const *pos)
+{
+	return pos_in_line(buf, pos);
+}
+
+char * line_ptr(struct buffer const *buf, size_t line)
+{
+	size_t cp_line;
+	size_t from = lindex_line_before(buf, line, &cp_line);
+	char const *b = off_to_ptr(buf, from);
+	if (cp_line == line)
+		return (char *)b;
+	line -= cp_line;
+
+	char const *segs[2][2] = {
+		{ b, buf->gap_b },
+		{ b < buf->gap_b ? buf->gap_e : b, buf->buf_e }
+	};
+
+	for (int i = 0; i < 2; i++) {
+		char const *p = segs[i][0];
+		char const *e = segs[i][1];
+		while (p < e && (p = memchr(p, '\n', e - p))) {
+			if (!--line)
+				return off_to_ptr(buf, ptr_to_off(buf, p) + 1);
+			p++;
+		}
+	}
+
+	return off_to_ptr(buf, buf_len(buf));
+}
+
+void mv_to_line(struct buffer *buf, size_t line, int col, size_t top_line)
+{
+	char *end = off_to_ptr(buf, buf_len(buf));
+	char *p = line_ptr(buf, line);
+	for (int i = 0; i < col && p != end && *p != '\n'; i++) {
+		char *next = next_symb(buf, p);
+		if (next == p)
+			break;
+		p = next;
+	}
+
+	buf->cursor = p;
+	buf->disp_b = line_ptr(buf, top_line);
+}
+
 char * ptr_to_line_b(struct buffer const *buf, char const *pos)
 {
 	char const *p = pos;
@@ -264,16 +328,6 @@ static char * find_ch(struct buffer const *buf, char const *start_pos,
         return (char *)ret;
 }
 
-static void del_ch(struct buffer *buf)
-{
-	move_gap(buf);
-
-	if (buf->gap_e + 1 <= buf->buf_e) {
-		buf->gap_e++;
-		buf->cursor++;
-	}
-}
-
 static int 
 count_symbols(struct buffer const *buf, char const *beg, char const *end)
 {
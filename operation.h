@@ -18,11 +18,13 @@ void del_symb(struct buffer *buf);
 // deleting symbol before cursor position (it maybe few bytes) from buffer
 void del_prev_symb(struct buffer *buf);
 
-// copy bytes that are between cursor and selection start to copy buffer
-int copy_sel(struct buffer *buf);
+// copy bytes that are between cursor and selection start to kill ring,
+// returns number of copied bytes
+size_t copy_sel(struct buffer *buf);
 
-// paste bytes from copy buffer to cursor point
-int paste(struct buffer *buf);
+// paste k-th newest kill ring entry to cursor point, len is set to its
+// length
+int paste(struct buffer *buf, size_t k, size_t *len);
 
 // delete bytes that are between cursor and selection start 
 void del_sel(struct buffer *buf);
@@ -30,6 +32,22 @@ void del_sel(struct buffer *buf);
 // move cursor point by lines number in direction
 void mv_by_lines(struct buffer *buf, int lines_num, int direction);
 
+// move cursor to the end of text and show last lines_num lines
+void mv_to_end(struct buffer *buf, int lines_num);
+
+// number of line (from 0) with position
+size_t line_num(struct buffer const *buf, char const *pos);
+
+// number of symbol (from 0) of position in its line
+int col_num(struct buffer const *buf, char const *pos);
+
+// returns pointer to begin of line with number (from 0) or to the end
+// of text if there is no such line
+char * line_ptr(struct buffer const *buf, size_t line);
+
+// move cursor to symbol col in line, top_line is shown first on screen
+void mv_to_line(struct buffer *buf, size_t line, int col, size_t top_line);
+
 // returns pointer to begin of line
 char * ptr_to_line_b(struct buffer const *buf, char const *start_pos);
 
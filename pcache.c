@@ -0,0 +1,139 @@
+#include "pcache.h"
+#include "slog.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct cpage * find_page(struct pcache *pc, size_t idx);
+static struct cpage * load_page(struct pcache *pc, size_t idx);
+
+struct pcache * pcache_open(char const *fname, size_t mem)
+{
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	struct pcache *pc = calloc(1, sizeof(struct pcache));
+	if (fstat(fd, &st) || !pc) {
+		free(pc);
+		close(fd);
+		return NULL;
+	}
+
+	pc->fd = fd;
+	pc->size = st.st_size;
+	pc->num = mem / PCACHE_PAGE;
+	if (pc->num < PCACHE_PAGES_MIN)
+		pc->num = PCACHE_PAGES_MIN;
+
+	// page memory is allocated when the slot is used first time
+	pc->pages = calloc(pc->num, sizeof(struct cpage));
+	if (!pc->pages) {
+		pcache_close(pc);
+		return NULL;
+	}
+	return pc;
+}
+
+void pcache_close(struct pcache *pc)
+{
+	if (!pc)
+		return;
+
+	log_si("pcache pages read", (int)pc->reads);
+	for (size_t i = 0; pc->pages && i < pc->num; i++)
+		free(pc->pages[i].data);
+	free(pc->pages);
+	close(pc->fd);
+	free(pc);
+}
+
+char const * pcache_get(struct pcache *pc, size_t off, size_t *len)
+{
+	if (off >= pc->size)
+		return NULL;
+
+	size_t idx = off / PCACHE_PAGE;
+	struct cpage *pg = pc->last;
+	if (!pg || pg->idx != idx) {
+		pg = find_page(pc, idx);
+		if (!pg && !(pg = load_page(pc, idx)))
+			return NULL;
+		pc->last = pg;
+	}
+	pg->used = ++pc->tick;
+
+	size_t in = off % PCACHE_PAGE;
+	if (in >= pg->len)
+		return NULL;
+	*len = pg->len - in;
+	return pg->data + in;
+}
+
+size_t pcache_read(struct pcache *pc, size_t off, char *dst, size_t len)
+{
+	size_t done = 0;
+	while (done < len) {
+		size_t n;
+		char const *p = pcache_get(pc, off + done, &n);
+		if (!p)
+			break;
+		if (n > len - done)
+			n = len - done;
+		memcpy(dst + done, p, n);
+		done += n;
+	}
+	return done;
+}
+
+// slots are few enough for linear search, it's done once per page
+static struct cpage * find_page(struct pcache *pc, size_t idx)
+{
+	for (size_t i = 0; i < pc->num; i++) {
+		if (pc->pages[i].used && pc->pages[i].idx == idx)
+			return &pc->pages[i];
+	}
+	return NULL;
+}
+
+// page is read to a free slot or to the least recently used one
+static struct cpage * load_page(struct pcache *pc, size_t idx)
+{
+	struct cpage *pg = &pc->pages[0];
+	for (size_t i = 1; i < pc->num && pg->used; i++) {
+		if (pc->pages[i].used < pg->used)
+			pg = &pc->pages[i];
+	}
+
+	if (!pg->data && !(pg->data = malloc(PCACHE_PAGE)))
+		return NULL;
+
+	pg->used = 0;
+	if (pc->last == pg)
+		pc->last = NULL;
+	size_t off = idx * PCACHE_PAGE;
+	size_t want = PCACHE_PAGE;
+	if (want > pc->size - off)
+		want = pc->size - off;
+
+	size_t got = 0;
+	while (got < want) {
+		ssize_t n = pread(pc->fd, pg->data + got, want - got, off + got);
+		if (n <= 0)
+			break;
+		got += n;
+	}
+	if (!got) {
+		log_ss("error", "pcache pread fail");
+		return NULL;
+	}
+
+	pg->idx = idx;
+	pg->len = got;
+	pc->reads++;
+	return pg;
+}
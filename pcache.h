@@ -0,0 +1,45 @@
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCACHE_PAGE (64 * 1024)   // file is read by aligned pages
+#define PCACHE_PAGES_MIN 4
+
+struct cpage {
+	size_t idx;           // page number in file
+	size_t len;           // less than PCACHE_PAGE only at the file end
+	uint64_t used;        // tick of the last access, 0 if slot is free
+	char *data;
+};
+
+/*
+ * Read-only file that is read with pread by pages that are kept in a
+ * fixed number of slots, the least recently used page is dropped when
+ * another one is needed. Memory is bounded by the number of slots
+ * whatever the file size.
+ */
+struct pcache {
+	int fd;
+	size_t size;          // file size when it was opened
+	struct cpage *pages;
+	size_t num;           // slots
+	uint64_t tick;
+	struct cpage *last;   // page of the last access
+	size_t reads;         // pages read from file
+};
+
+// open file with cache of about mem bytes, NULL on error
+struct pcache * pcache_open(char const *fname, size_t mem);
+
+void pcache_close(struct pcache *pc);
+
+// bytes from offset to the end of its page, len is set to their number.
+// NULL if offset is out of file or page can't be read
+char const * pcache_get(struct pcache *pc, size_t off, size_t *len);
+
+// copy up to len bytes at offset to dst, returns number of copied bytes
+size_t pcache_read(struct pcache *pc, size_t off, char *dst, size_t len);
+
+#endif /* PCACHE_H */
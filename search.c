@@ -0,0 +1,266 @@
+#include "search.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void * worker(void *arg);
+static int run_task(struct search *s, struct search_task *t, char *blk);
+static int add_match(struct search_task *t, size_t off);
+static size_t first_from(struct search_task const *t, size_t off);
+
+struct search * search_start(struct buffer *buf, char const *pat,
+                             size_t len, size_t from)
+{
+	if (!len || len > FIND_MAX)
+		return NULL;
+
+	struct search *s = calloc(1, sizeof(struct search));
+	if (!s)
+		return NULL;
+
+	s->snap = snap_take(buf);
+	s->num = buf_len(buf) / SEARCH_CHUNK + 1;
+	s->tasks = calloc(s->num, sizeof(struct search_task));
+	if (!s->snap || !s->tasks) {
+		snap_put(s->snap);
+		free(s->tasks);
+		free(s);
+		return NULL;
+	}
+
+	memcpy(s->pat, pat, len);
+	s->len = len;
+	s->changes = buf->changes;
+	for (size_t i = 0; i < s->num; i++) {
+		s->tasks[i].b = i * SEARCH_CHUNK;
+		s->tasks[i].e = s->tasks[i].b + SEARCH_CHUNK;
+	}
+	s->tasks[s->num - 1].e = buf_len(buf);
+	s->first = from / SEARCH_CHUNK;
+	if (s->first >= s->num)
+		s->first = s->num - 1;
+	pthread_mutex_init(&s->lock, NULL);
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = (cpus > 0) ? cpus : 1;
+	if (threads > SEARCH_THREADS_MAX)
+		threads = SEARCH_THREADS_MAX;
+	if (threads > s->num)
+		threads = s->num;
+
+	for (size_t i = 0; i < threads; i++) {
+		if (pthread_create(&s->threads[i], NULL, worker, s))
+			break;
+		s->threads_num++;
+	}
+	if (!s->threads_num)
+		worker(s);
+
+	return s;
+}
+
+void search_stop(struct search *s)
+{
+	if (!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_mutex_unlock(&s->lock);
+	for (size_t i = 0; i < s->threads_num; i++)
+		pthread_join(s->threads[i], NULL);
+
+	if (s->failed)
+		log_ss("error", "search failed");
+	log_si("search matches", (int)s->found);
+
+	for (size_t i = 0; i < s->num; i++)
+		free(s->tasks[i].offs);
+	free(s->tasks);
+	snap_put(s->snap);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+/*
+ * Tasks are looked at from the one with offset towards the search
+ * direction. Offsets in a task are final once it's done.
+ */
+long search_next(struct search *s, size_t off, int prev)
+{
+	size_t t0 = off / SEARCH_CHUNK;
+	if (t0 >= s->num)
+		t0 = s->num - 1;
+
+	long ret = -1;
+	pthread_mutex_lock(&s->lock);
+	for (size_t k = 0; k <= s->num; k++) {
+		size_t i = prev ? (t0 + s->num - k % s->num) % s->num
+		                : (t0 + k) % s->num;
+		struct search_task const *t = &s->tasks[i];
+		if (!t->done) {
+			ret = -2;
+			break;
+		}
+		if (!t->num)
+			continue;
+
+		// the first task is looked at again after wrap around
+		size_t j = first_from(t, off);
+		if (!prev && k == 0 && j < t->num) {
+			ret = t->offs[j];
+		} else if (!prev && k == s->num && j) {
+			ret = t->offs[0];
+		} else if (!prev && k && k < s->num) {
+			ret = t->offs[0];
+		} else if (prev && k == 0 && j) {
+			ret = t->offs[j - 1];
+		} else if (prev && k == s->num && j < t->num) {
+			ret = t->offs[t->num - 1];
+		} else if (prev && k && k < s->num) {
+			ret = t->offs[t->num - 1];
+		}
+		if (ret >= 0)
+			break;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return ret;
+}
+
+size_t search_count(struct search *s, int *done)
+{
+	pthread_mutex_lock(&s->lock);
+	size_t found = s->found;
+	*done = (s->tasks_done == s->num);
+	pthread_mutex_unlock(&s->lock);
+	return found;
+}
+
+size_t search_index(struct search *s, size_t off)
+{
+	size_t t0 = off / SEARCH_CHUNK;
+	if (t0 >= s->num)
+		return 0;
+
+	size_t idx = 0;
+	pthread_mutex_lock(&s->lock);
+	for (size_t i = 0; i <= t0 && idx != (size_t)-1; i++) {
+		struct search_task const *t = &s->tasks[i];
+		if (!t->done)
+			idx = (size_t)-1;
+		else if (i < t0)
+			idx += t->num;
+	}
+	if (idx != (size_t)-1) {
+		struct search_task const *t = &s->tasks[t0];
+		size_t j = first_from(t, off);
+		if (j < t->num && t->offs[j] == off)
+			idx += j + 1;
+		else
+			idx = 0;
+	} else {
+		idx = 0;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return idx;
+}
+
+static void * worker(void *arg)
+{
+	struct search *s = arg;
+	char *blk = malloc(SEARCH_BLOCK + FIND_MAX);
+
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		if (s->stop || s->next_task == s->num || !blk) {
+			if (!blk)
+				s->failed = 1;
+			pthread_mutex_unlock(&s->lock);
+			break;
+		}
+		struct search_task *t = &s->tasks[(s->first + s->next_task++)
+		                                  % s->num];
+		pthread_mutex_unlock(&s->lock);
+
+		int rc = run_task(s, t, blk);
+
+		pthread_mutex_lock(&s->lock);
+		if (rc != SUCCESS || !snap_valid(s->snap))
+			s->failed = 1;
+		t->done = 1;
+		s->tasks_done++;
+		s->found += t->num;
+		pthread_mutex_unlock(&s->lock);
+	}
+
+	free(blk);
+	return NULL;
+}
+
+// text is read by blocks that overlap by pattern length minus one, so
+// matches across block ends are found
+static int run_task(struct search *s, struct search_task *t, char *blk)
+{
+	size_t text_len = s->snap->len;
+	for (size_t pos = t->b; pos < t->e; pos += SEARCH_BLOCK) {
+		pthread_mutex_lock(&s->lock);
+		int stop = s->stop;
+		pthread_mutex_unlock(&s->lock);
+		if (stop)
+			return SUCCESS;
+
+		size_t n = SEARCH_BLOCK + s->len - 1;
+		if (n > text_len - pos)
+			n = text_len - pos;
+		n = snap_read(s->snap, pos, blk, n);
+
+		char const *p = blk;
+		char const *end = blk + n;
+		while (end - p >= (long)s->len) {
+			char const *q = memmem(p, end - p, s->pat, s->len);
+			if (!q)
+				break;
+			size_t off = pos + (q - blk);
+			if (off >= t->e || q - blk >= SEARCH_BLOCK)
+				break;
+			if (add_match(t, off) != SUCCESS)
+				return ERROR;
+			p = q + 1;
+		}
+	}
+	return SUCCESS;
+}
+
+static int add_match(struct search_task *t, size_t off)
+{
+	if (t->num == t->size) {
+		size_t size = t->size ? t->size * 2 : 64;
+		size_t *p = realloc(t->offs, size * sizeof(size_t));
+		if (!p)
+			return ERROR;
+		t->offs = p;
+		t->size = size;
+	}
+	t->offs[t->num++] = off;
+	return SUCCESS;
+}
+
+// index of first match in task at offset off or after it
+static size_t first_from(struct search_task const *t, size_t off)
+{
+	size_t lo = 0;
+	size_t hi = t->num;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (t->offs[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
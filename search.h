@@ -0,0 +1,71 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "buffer.h"
+#include "snap.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define SEARCH_CHUNK (8 * 1024 * 1024)   // bytes searched by one task
+#define SEARCH_BLOCK (1024 * 1024)       // bytes read from snapshot at once
+#define SEARCH_THREADS_MAX 16
+
+// matches that start in [b, e) of snapshot text
+struct search_task {
+	size_t b;
+	size_t e;
+	size_t *offs;         // sorted offsets of matches
+	size_t num;
+	size_t size;
+	int done;
+};
+
+/*
+ * Search of all occurrences of a pattern (overlapping ones too) by a
+ * pool of threads. Text is read from a snapshot, so the buffer can be
+ * edited meanwhile. It's split in chunks that overlap by pattern length
+ * minus one, and each match is found in the chunk where it starts, so
+ * the chunks need no merging: tasks in offset order give all matches in
+ * order. Tasks are taken from the one with the cursor onwards, so the
+ * next match is known long before the whole text is searched.
+ */
+struct search {
+	struct snap *snap;
+	char pat[FIND_MAX];
+	size_t len;
+	size_t changes;       // buf->changes when search was started
+	struct search_task *tasks;
+	size_t num;
+	size_t first;         // task that is taken first
+	size_t next_task;     // number of tasks taken
+	size_t tasks_done;
+	size_t found;         // matches in tasks that are done
+	int stop;
+	int failed;           // no memory for matches or text was lost
+	pthread_mutex_t lock;
+	pthread_t threads[SEARCH_THREADS_MAX];
+	size_t threads_num;
+};
+
+// start search of len bytes of pat in buffer text, offset from is looked
+// at first. NULL if it can't be started
+struct search * search_start(struct buffer *buf, char const *pat,
+                             size_t len, size_t from);
+
+// stop threads and free search
+void search_stop(struct search *s);
+
+// offset of first match at offset off or after it (or last one before it
+// if prev isn't 0), search wraps around text end. -1 if there is no match,
+// -2 if it's not known yet
+long search_next(struct search *s, size_t off, int prev);
+
+// number of matches found so far, done is set if search is finished
+size_t search_count(struct search *s, int *done);
+
+// number (from 1) of match at offset among all matches, 0 if it's not
+// known yet
+size_t search_index(struct search *s, size_t off);
+
+#endif /* SEARCH_H */
@@ -0,0 +1,275 @@
+#include "snap.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// guards pieces, owners and lists of all snapshots. Readers copy a
+// block at a time side by side, editing thread waits at most for one
+// block and is let in before new readers
+static pthread_rwlock_t lock =
+	PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+
+static int split(struct snap *s, size_t i, char const *b, char const *e,
+                 struct snap_chunk *chunk, char const *chunk_b);
+static int reserve(struct snap *s, size_t num);
+static void unlink_snap(struct snap *s);
+static void lose(struct snap *s);
+static void free_pieces(struct snap *s);
+
+struct snap * snap_take(struct buffer *buf)
+{
+	struct snap *s = calloc(1, sizeof(struct snap));
+	if (!s || reserve(s, 2) != SUCCESS) {
+		free(s);
+		return NULL;
+	}
+
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	size_t after_gap = buf->buf_e - buf->gap_e;
+	if (before_gap)
+		s->pieces[s->num++] = (struct snap_piece){buf->buf_b,
+		                                          before_gap, NULL};
+	if (after_gap)
+		s->pieces[s->num++] = (struct snap_piece){buf->gap_e,
+		                                          after_gap, NULL};
+	s->len = before_gap + after_gap;
+	s->refs = 1;
+
+	pthread_rwlock_wrlock(&lock);
+	if (s->num) {
+		s->buf = buf;
+		s->next = buf->snaps;
+		buf->snaps = s;
+	}
+	pthread_rwlock_unlock(&lock);
+
+	return s;
+}
+
+struct snap * snap_get(struct snap *s)
+{
+	pthread_rwlock_wrlock(&lock);
+	s->refs++;
+	pthread_rwlock_unlock(&lock);
+	return s;
+}
+
+void snap_put(struct snap *s)
+{
+	if (!s)
+		return;
+
+	pthread_rwlock_wrlock(&lock);
+	int last = !--s->refs;
+	if (last) {
+		unlink_snap(s);
+		free_pieces(s);
+	}
+	pthread_rwlock_unlock(&lock);
+
+	if (last)
+		free(s);
+}
+
+size_t snap_read(struct snap *s, size_t off, char *dst, size_t len)
+{
+	size_t done = 0;
+	size_t piece_b = 0;
+
+	pthread_rwlock_rdlock(&lock);
+	for (size_t i = 0; i < s->num && done < len; i++) {
+		struct snap_piece const *pc = &s->pieces[i];
+		size_t piece_e = piece_b + pc->len;
+		if (off + done < piece_e) {
+			size_t from = off + done - piece_b;
+			size_t n = pc->len - from;
+			if (n > len - done)
+				n = len - done;
+			memcpy(dst + done, pc->p + from, n);
+			done += n;
+		}
+		piece_b = piece_e;
+	}
+	pthread_rwlock_unlock(&lock);
+
+	return done;
+}
+
+/*
+ * Range is widened to SNAP_BLOCK aligned blocks, so a series of small
+ * edits copies each block once, and one chunk takes the bytes of all
+ * snapshots. Snapshots that don't point to buffer any more are taken
+ * off its list, so later edits don't look at them.
+ */
+int snap_cow(struct buffer *buf, char const *b, char const *e)
+{
+	pthread_rwlock_wrlock(&lock);
+	if (!buf->snaps || b >= e) {
+		pthread_rwlock_unlock(&lock);
+		return SUCCESS;
+	}
+
+	size_t blk_b = (size_t)(b - buf->buf_b) & ~(size_t)(SNAP_BLOCK - 1);
+	size_t blk_e = (size_t)(e - buf->buf_b) + SNAP_BLOCK - 1;
+	blk_e &= ~(size_t)(SNAP_BLOCK - 1);
+	b = buf->buf_b + blk_b;
+	e = (blk_e < (size_t)(buf->buf_e - buf->buf_b)) ? buf->buf_b + blk_e
+	                                                : buf->buf_e;
+
+	// bytes that are pointed to
+	char const *lo = e;
+	char const *hi = b;
+	for (struct snap *s = buf->snaps; s; s = s->next) {
+		for (size_t i = 0; i < s->num; i++) {
+			struct snap_piece const *pc = &s->pieces[i];
+			if (pc->chunk || pc->p >= e || pc->p + pc->len <= b)
+				continue;
+			if (pc->p < lo)
+				lo = pc->p > b ? pc->p : b;
+			if (pc->p + pc->len > hi)
+				hi = pc->p + pc->len < e ? pc->p + pc->len : e;
+		}
+	}
+
+	// chunk is held here too, so a snapshot that loses its pieces
+	// can't free it under the others
+	int rc = SUCCESS;
+	struct snap_chunk *chunk = NULL;
+	if (lo < hi) {
+		chunk = malloc(sizeof(struct snap_chunk) + (hi - lo));
+		if (chunk) {
+			memcpy(chunk->data, lo, hi - lo);
+			chunk->refs = 1;
+		} else {
+			log_ss("error", "snap_cow malloc fail");
+		}
+	}
+
+	struct snap *s = buf->snaps;
+	while (s) {
+		struct snap *next = s->next;
+		int ok = 1;
+		for (size_t i = 0; i < s->num && lo < hi; i++) {
+			struct snap_piece const *pc = &s->pieces[i];
+			if (pc->chunk || pc->p >= hi || pc->p + pc->len <= lo)
+				continue;
+			int n = chunk ? split(s, i, lo, hi, chunk, lo) : -1;
+			if (n < 0) {
+				ok = 0;
+				break;
+			}
+			i += n - 1;
+		}
+
+		size_t borrowed = 0;
+		for (size_t i = 0; ok && i < s->num; i++)
+			borrowed += !s->pieces[i].chunk;
+
+		if (!ok) {
+			lose(s);
+			rc = ERROR;
+		} else if (!borrowed) {
+			unlink_snap(s);
+		}
+		s = next;
+	}
+
+	if (chunk && !--chunk->refs)
+		free(chunk);
+	pthread_rwlock_unlock(&lock);
+
+	return rc;
+}
+
+int snap_valid(struct snap *s)
+{
+	pthread_rwlock_rdlock(&lock);
+	int valid = !s->lost;
+	pthread_rwlock_unlock(&lock);
+	return valid;
+}
+
+// piece i is split into up to three, its bytes in [b, e) are taken from
+// chunk. Returns number of pieces it became, -1 if there is no memory
+static int split(struct snap *s, size_t i, char const *b, char const *e,
+                 struct snap_chunk *chunk, char const *chunk_b)
+{
+	if (reserve(s, s->num + 2) != SUCCESS)
+		return -1;
+
+	struct snap_piece pc = s->pieces[i];
+	char const *pc_e = pc.p + pc.len;
+	char const *mid_b = pc.p > b ? pc.p : b;
+	char const *mid_e = pc_e < e ? pc_e : e;
+
+	struct snap_piece parts[3];
+	int n = 0;
+	if (pc.p < mid_b)
+		parts[n++] = (struct snap_piece){pc.p, mid_b - pc.p, NULL};
+	parts[n++] = (struct snap_piece){chunk->data + (mid_b - chunk_b),
+	                                 mid_e - mid_b, chunk};
+	chunk->refs++;
+	if (mid_e < pc_e)
+		parts[n++] = (struct snap_piece){mid_e, pc_e - mid_e, NULL};
+
+	memmove(s->pieces + i + n, s->pieces + i + 1,
+	        (s->num - i - 1) * sizeof(struct snap_piece));
+	memcpy(s->pieces + i, parts, n * sizeof(struct snap_piece));
+	s->num += n - 1;
+
+	return n;
+}
+
+static int reserve(struct snap *s, size_t num)
+{
+	if (num <= s->size)
+		return SUCCESS;
+
+	size_t size = s->size ? s->size * 2 : SNAP_PIECES_INIT;
+	while (size < num)
+		size *= 2;
+
+	struct snap_piece *p = realloc(s->pieces,
+	                               size * sizeof(struct snap_piece));
+	if (!p)
+		return ERROR;
+	s->pieces = p;
+	s->size = size;
+	return SUCCESS;
+}
+
+static void unlink_snap(struct snap *s)
+{
+	if (!s->buf)
+		return;
+
+	struct snap **p = &s->buf->snaps;
+	while (*p && *p != s)
+		p = &(*p)->next;
+	if (*p)
+		*p = s->next;
+	s->next = NULL;
+	s->buf = NULL;
+}
+
+static void lose(struct snap *s)
+{
+	unlink_snap(s);
+	free_pieces(s);
+	s->lost = 1;
+}
+
+static void free_pieces(struct snap *s)
+{
+	for (size_t i = 0; i < s->num; i++) {
+		struct snap_chunk *chunk = s->pieces[i].chunk;
+		if (chunk && !--chunk->refs)
+			free(chunk);
+	}
+	free(s->pieces);
+	s->pieces = NULL;
+	s->num = s->size = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+#include "buffer.h"
+
+#include <stddef.h>
+
+#define SNAP_BLOCK (64 * 1024)   // bytes are copied out by aligned blocks
+#define SNAP_PIECES_INIT 4
+
+/*
+ * Snapshot of buffer text that other threads can read while the text is
+ * edited. It's taken in O(1): it's a list of pieces that point right to
+ * the two sides of the gap. Before the buffer changes or frees bytes that
+ * a snapshot points to, they are copied to a chunk, which is shared by
+ * all snapshots that had them (copy-on-write). Buffer memory is changed
+ * only by the thread that edits it, so snapshots are taken and copied
+ * there, and read or released anywhere.
+ */
+
+// bytes copied out of buffer memory before they were changed
+struct snap_chunk {
+	size_t refs;          // pieces that point into it
+	char data[];
+};
+
+struct snap_piece {
+	char const *p;
+	size_t len;
+	struct snap_chunk *chunk;  // NULL while bytes are in buffer memory
+};
+
+struct snap {
+	struct buffer *buf;   // NULL when nothing points to buffer memory
+	size_t len;           // text length
+	struct snap_piece *pieces;
+	size_t num;
+	size_t size;          // allocated number of pieces
+	size_t refs;          // owners
+	int lost;             // bytes couldn't be copied, text is lost
+	struct snap *next;    // in list of snapshots that point to buffer
+};
+
+// snapshot of the whole text, NULL if there is no memory
+struct snap * snap_take(struct buffer *buf);
+
+// one more owner of snapshot, e.g. for a worker thread
+struct snap * snap_get(struct snap *s);
+
+// owner doesn't need snapshot any more, it's freed with the last one
+void snap_put(struct snap *s);
+
+// copy up to len bytes of snapshot text at offset to dst, returns number
+// of bytes that were copied. Readers of all snapshots copy in parallel
+size_t snap_read(struct snap *s, size_t off, char *dst, size_t len);
+
+// bytes [b, e) of buffer memory are going to be changed, moved or freed,
+// so snapshots that point to them get their copy. ERROR if there is no
+// memory for it, then those snapshots lose their text (see snap_valid)
+int snap_cow(struct buffer *buf, char const *b, char const *e);
+
+// false if snapshot lost its text because copy couldn't be made
+int snap_valid(struct snap *s);
+
+#endif /* SNAP_H */
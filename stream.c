@@ -0,0 +1,87 @@
+#include "stream.h"
+#include "buffer.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int stream_take_stdin(void)
+{
+	int fd = dup(STDIN_FILENO);
+	if (fd < 0)
+		return -1;
+
+	if (!freopen("/dev/tty", "r", stdin)) {
+		log_ss("error", "stream_take_stdin can't open /dev/tty");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int stream_start(struct buffer *buf, int fd)
+{
+	struct stream *st = calloc(1, sizeof(struct stream));
+	if (!st)
+		return ERROR;
+
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		free(st);
+		return ERROR;
+	}
+
+	st->fd = fd;
+	buf->stream = st;
+	return SUCCESS;
+}
+
+long stream_update(struct buffer *buf)
+{
+	struct stream *st = buf->stream;
+	if (!st)
+		return -1;
+
+	long total = 0;
+	st->more = 0;
+	while (total < STREAM_TICK_BYTES) {
+		char *dst = gap_at_end(buf, STREAM_CHUNK);
+		if (!dst) {
+			log_ss("error", "stream_update gap_at_end fail");
+			return -1;
+		}
+
+		ssize_t n = read(st->fd, dst, STREAM_CHUNK);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			st->more = (total > 0);
+			return total;
+		}
+		if (n <= 0)
+			return total ? total : -1;
+
+		commit_end(buf, n);
+		st->bytes += n;
+		total += n;
+	}
+
+	st->more = 1;
+	return total;
+}
+
+void stream_stop(struct buffer *buf)
+{
+	struct stream *st = buf->stream;
+	if (!st)
+		return;
+
+	close(st->fd);
+	free(st);
+	buf->stream = NULL;
+}
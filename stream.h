@@ -0,0 +1,35 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "buffer.h"
+
+#define STDIN_FNAME "-"
+#define STREAM_CHUNK (1024 * 1024)
+#define STREAM_TICK_BYTES (8 * STREAM_CHUNK)
+#define STREAM_POLL_MS 50
+
+/*
+ * Text read from pipe while editor is already running. It's read in
+ * large chunks right into the gap at the end of buffer.
+ */
+struct stream {
+	int fd;
+	size_t bytes;    // bytes read so far
+	int more;        // last update got data, more could be ready
+};
+
+// take pipe from stdin and reopen stdin on terminal for ncurses.
+// returns descriptor of pipe or -1
+int stream_take_stdin(void);
+
+// start reading fd to the end of buffer
+int stream_start(struct buffer *buf, int fd);
+
+// read available data, up to STREAM_TICK_BYTES. returns number of
+// bytes read, 0 if there was no data and -1 on EOF or error
+long stream_update(struct buffer *buf);
+
+// stop reading and close descriptor
+void stream_stop(struct buffer *buf);
+
+#endif /* STREAM_H */
@@ -0,0 +1,38 @@
+#include "term.h"
+
+#include <locale.h>
+#include <ncurses.h>
+
+void term_setup(void)
+{
+	setlocale(LC_ALL, "");
+	initscr();
+	cbreak();
+	keypad(stdscr, TRUE);
+	noecho();
+	set_escdelay(20);
+}
+
+// cursor is shown while input is typed, viewer hides it otherwise
+void get_input(char const *prompt, char *input, int size)
+{
+	int vis = curs_set(1);
+	term_status(prompt);
+	attron(A_REVERSE);
+	echo();
+	getnstr(input, size);
+	noecho();
+	attroff(A_REVERSE);
+	if (vis != ERR)
+		curs_set(vis);
+}
+
+void term_status(char const *str)
+{
+	attron(A_REVERSE);
+	move(LINES - 1, 0);
+	for (int i = 0; i < COLS; i++)
+		addch(' ');
+	mvaddnstr(LINES - 1, 0, str, COLS);
+	attroff(A_REVERSE);
+}
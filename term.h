@@ -0,0 +1,22 @@
+#ifndef TERM_H
+#define TERM_H
+
+#define TAB_LEN 8
+#define COLS_MAX 256
+#define KEY_CTRL(c) ((c) & 0x1f)
+
+/*
+ * Curses setup and bottom line of the screen, they are shared by the
+ * editor and the read-only viewer.
+ */
+
+// start curses with keys read one by one and not echoed
+void term_setup(void);
+
+// read line of input at the bottom line after prompt
+void get_input(char const *prompt, char *input, int size);
+
+// show str at the bottom line, cursor is left after it
+void term_status(char const *str);
+
+#endif /* TERM_H */
@@ -0,0 +1,98 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "buffer.h"
+#include "rc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Helpers of the tests run by make check. Each test applies edits both
+ * to a structure and to a plain copy of the text (reference), and stops
+ * at the first difference with file and line of the failed check.
+ */
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+		        __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+// text kept in one array, edits are done by memmove
+struct ref {
+	char *p;
+	size_t len;
+	size_t size;
+};
+
+static inline void ref_ins(struct ref *r, size_t off, char const *src,
+                           size_t len)
+{
+	if (r->len + len > r->size) {
+		r->size = (r->len + len) * 2;
+		r->p = realloc(r->p, r->size);
+		CHECK(r->p);
+	}
+	memmove(r->p + off + len, r->p + off, r->len - off);
+	memcpy(r->p + off, src, len);
+	r->len += len;
+}
+
+static inline void ref_del(struct ref *r, size_t off, size_t len)
+{
+	memmove(r->p + off, r->p + off + len, r->len - off - len);
+	r->len -= len;
+}
+
+// len random bytes of alphabet
+static inline void rand_text(char *dst, size_t len, char const *alphabet)
+{
+	size_t n = strlen(alphabet);
+	for (size_t i = 0; i < len; i++)
+		dst[i] = alphabet[rand() % n];
+}
+
+// one random insertion, deletion or overwrite of up to max bytes, done
+// on both buffer and reference
+static inline void rand_edit(struct buffer *buf, struct ref *r,
+                             char const *alphabet, size_t max)
+{
+	char *src = malloc(max + 1);
+	CHECK(src);
+	size_t off = r->len ? (size_t)rand() % (r->len + 1) : 0;
+	size_t len = (size_t)rand() % (max + 1);
+	rand_text(src, len, alphabet);
+
+	switch (rand() % 3) {
+	case 0:
+		CHECK(insert_bytes(buf, off, src, len) == SUCCESS);
+		ref_ins(r, off, src, len);
+		break;
+	case 1:
+		if (len > r->len - off)
+			len = r->len - off;
+		delete_bytes(buf, off, len);
+		ref_del(r, off, len);
+		break;
+	default:
+		if (len > r->len - off)
+			len = r->len - off;
+		CHECK(set_bytes(buf, off, src, len) == SUCCESS);
+		memcpy(r->p + off, src, len);
+		break;
+	}
+	free(src);
+}
+
+static inline void check_text(struct buffer const *buf, struct ref const *r)
+{
+	CHECK(buf_len(buf) == r->len);
+	for (size_t i = 0; i < r->len; i++)
+		CHECK(*off_to_ptr(buf, i) == r->p[i]);
+}
+
+#endif /* CHECK_H */
@@ -0,0 +1,65 @@
+#include "check.h"
+#include "journal.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define EDITS 5000
+
+/*
+ * Random edits are journaled, then the file is loaded again and the
+ * journal replayed on it must give the edited text. A journal that lost
+ * a record must not be offered for replay.
+ */
+int main(void)
+{
+	char dir[] = "/tmp/edit-check-XXXXXX";
+	char fname[FNAMELEN_MAX], jname[JOURNAL_FNAME_MAX];
+	CHECK(mkdtemp(dir));
+	snprintf(fname, sizeof(fname), "%s/text", dir);
+	snprintf(jname, sizeof(jname), "%s/%stext%s", dir, JOURNAL_PREFIX,
+	         JOURNAL_SUFFIX);
+
+	struct ref r = {0};
+	char init[4096];
+	srand(1);
+	rand_text(init, sizeof(init), "abc \n");
+	ref_ins(&r, 0, init, sizeof(init));
+	FILE *fp = fopen(fname, "w");
+	CHECK(fp);
+	CHECK(fwrite(init, 1, sizeof(init), fp) == sizeof(init));
+	fclose(fp);
+
+	struct buffer *buf = create_buffer();
+	CHECK(buf && load_file(buf, fname) == SUCCESS);
+	CHECK(journal_open(buf, 0) == SUCCESS);
+	for (int i = 0; i < EDITS; i++)
+		rand_edit(buf, &r, "abc \n", 100);
+	journal_close(buf, 0);
+	delete_buffer(buf);
+
+	buf = create_buffer();
+	CHECK(buf && load_file(buf, fname) == SUCCESS);
+	CHECK(journal_exists(fname));
+	CHECK(journal_replay(buf) == SUCCESS);
+	check_text(buf, &r);
+
+	CHECK(journal_open(buf, 0) == SUCCESS);
+	CHECK(insert_bytes(buf, 0, "x", 1) == SUCCESS);
+	ref_ins(&r, 0, "x", 1);
+	while (!journal_exists(fname))
+		usleep(10000);
+	pthread_mutex_lock(&buf->jnl->lock);
+	buf->jnl->failed = 1;
+	pthread_mutex_unlock(&buf->jnl->lock);
+	rand_edit(buf, &r, "abc \n", 100);
+	journal_close(buf, 0);
+	CHECK(!journal_exists(fname));
+	delete_buffer(buf);
+
+	unlink(jname);
+	unlink(fname);
+	rmdir(dir);
+	free(r.p);
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "check.h"
+#include "kring.h"
+
+#define PUSHES 200
+#define TEXT_LEN (64 * 1024)
+#define ENTRY_MAX 3000
+
+/*
+ * Entries of the kill ring are compared with the texts that were pushed.
+ * Small ones fit the budget, so the arena grows and keeps KRING_MAX of
+ * them instead of wrapping. Entry larger than the budget is kept alone.
+ */
+int main(void)
+{
+	struct buffer *buf = create_buffer();
+	char *text = malloc(TEXT_LEN);
+	size_t offs[PUSHES], lens[PUSHES];
+	CHECK(buf && text);
+
+	srand(1);
+	rand_text(text, TEXT_LEN, "abcdefgh\n");
+	CHECK(insert_bytes(buf, 0, text, TEXT_LEN) == SUCCESS);
+
+	for (size_t i = 0; i < PUSHES; i++) {
+		lens[i] = 1 + rand() % ENTRY_MAX;
+		offs[i] = rand() % (TEXT_LEN - lens[i]);
+		CHECK(kring_push(buf, offs[i], lens[i]) == SUCCESS);
+
+		size_t num = kring_num();
+		CHECK(num == (i + 1 < KRING_MAX ? i + 1 : KRING_MAX));
+		for (size_t k = 0; k < num; k++) {
+			size_t len;
+			char const *p = kring_get(k, &len);
+			CHECK(p && len == lens[i - k]);
+			CHECK(!memcmp(p, text + offs[i - k], len));
+		}
+	}
+	size_t len;
+	CHECK(!kring_get(KRING_MAX, &len));
+
+	size_t big_len = KRING_BUDGET + 1;
+	char *big = malloc(big_len);
+	CHECK(big);
+	memset(big, 'x', big_len);
+	CHECK(insert_bytes(buf, 0, big, big_len) == SUCCESS);
+	CHECK(kring_push(buf, 0, big_len) == SUCCESS);
+	CHECK(kring_num() == 1);
+	char const *p = kring_get(0, &len);
+	CHECK(p && len == big_len && !memcmp(p, big, len));
+
+	kring_free();
+	CHECK(!kring_num());
+	delete_buffer(buf);
+	free(big);
+	free(text);
+	return 0;
+}
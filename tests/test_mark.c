@@ -0,0 +1,70 @@
+#include "check.h"
+#include "mark.h"
+
+#define MARKS 500
+#define EDITS 50000
+#define TEXT_LEN 100000
+
+/*
+ * Marks of the treap are compared with offsets that are shifted one by
+ * one on each insertion and deletion.
+ */
+int main(void)
+{
+	struct mark_set *set = marks_create();
+	struct mark *m[MARKS];
+	size_t ref[MARKS];
+	CHECK(set);
+
+	srand(1);
+	for (int i = 0; i < MARKS; i++) {
+		ref[i] = rand() % TEXT_LEN;
+		m[i] = mark_new(set, ref[i]);
+		CHECK(m[i]);
+	}
+
+	for (int it = 0; it < EDITS; it++) {
+		size_t off = rand() % TEXT_LEN;
+		size_t len = rand() % 50;
+		int op = rand() % 5;
+		int i = rand() % MARKS;
+
+		if (op < 2) {
+			marks_ins(set, off, len);
+			for (int j = 0; j < MARKS; j++)
+				if (m[j] && ref[j] > off)
+					ref[j] += len;
+		} else if (op < 4) {
+			marks_del(set, off, len);
+			for (int j = 0; j < MARKS; j++) {
+				if (!m[j] || ref[j] <= off)
+					continue;
+				ref[j] = ref[j] >= off + len ? ref[j] - len : off;
+			}
+		} else if (!m[i]) {
+			ref[i] = off;
+			m[i] = mark_new(set, off);
+			CHECK(m[i]);
+		} else if (rand() % 2) {
+			mark_free(set, m[i]);
+			m[i] = NULL;
+		} else {
+			ref[i] = off;
+			mark_move(set, m[i], off);
+		}
+
+		if (it % 100)
+			continue;
+		size_t num = 0;
+		for (int j = 0; j < MARKS; j++) {
+			if (!m[j])
+				continue;
+			CHECK(mark_off(m[j]) == ref[j]);
+			num++;
+		}
+		CHECK(set->num == num);
+	}
+
+	marks_delete(set);
+	return 0;
+}
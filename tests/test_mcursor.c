@@ -0,0 +1,133 @@
+#include "check.h"
+#include "mcursor.h"
+
+#define ROUNDS 20
+#define EDITS 50
+#define CURSORS 100
+#define TEXT_LEN 20000
+
+// sorted cursor offsets with the main one among them
+struct cursors {
+	size_t off[CURSORS + 1];
+	size_t num;
+	size_t main;     // index of main cursor
+};
+
+// drop offsets that became the same, main cursor is kept
+static void merge(struct cursors *c)
+{
+	size_t main_off = c->off[c->main];
+	size_t n = 0;
+	for (size_t i = 0; i < c->num; i++) {
+		if (n && c->off[n - 1] == c->off[i])
+			continue;
+		if (c->off[i] == main_off)
+			c->main = n;
+		c->off[n++] = c->off[i];
+	}
+	c->num = n;
+}
+
+static void ref_insert(struct ref *r, struct cursors *c, char const *src,
+                       size_t len)
+{
+	for (size_t i = c->num; i--;)
+		ref_ins(r, c->off[i], src, len);
+	for (size_t i = 0; i < c->num; i++)
+		c->off[i] += (i + 1) * len;
+}
+
+// symbols are single bytes, deletion doesn't reach the next cursor
+static void ref_delete(struct ref *r, struct cursors *c, int prev)
+{
+	size_t lens[CURSORS + 1];
+	for (size_t i = 0; i < c->num; i++) {
+		size_t limit = prev ? (i ? c->off[i - 1] : 0)
+		                    : (i + 1 < c->num ? c->off[i + 1] : r->len);
+		lens[i] = c->off[i] != limit;
+	}
+	for (size_t i = c->num; i--;)
+		ref_del(r, c->off[i] - (prev ? lens[i] : 0), lens[i]);
+
+	size_t shift = 0;
+	for (size_t i = 0; i < c->num; i++) {
+		c->off[i] -= shift + (prev ? lens[i] : 0);
+		shift += lens[i];
+	}
+	merge(c);
+}
+
+static void check_cursors(struct buffer *buf, struct cursors const *c)
+{
+	CHECK(ptr_to_off(buf, buf->cursor) == c->off[c->main]);
+	CHECK(buf->mc && buf->mc->num == c->num - 1);
+	for (size_t i = 0, j = 0; i < c->num; i++)
+		if (i != c->main)
+			CHECK(buf->mc->off[j++] == c->off[i]);
+}
+
+static int cmp_off(void const *a, void const *b)
+{
+	size_t x = *(size_t const *)a, y = *(size_t const *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Random cursors are put in text and symbols are typed and deleted at all
+ * of them, the text and cursors are compared with edits done at each
+ * cursor one by one.
+ */
+int main(void)
+{
+	struct buffer *buf = create_buffer();
+	char *text = malloc(TEXT_LEN);
+	struct ref r = {0};
+	struct cursors c;
+	CHECK(buf && text);
+
+	srand(1);
+	for (int i = 0; i < ROUNDS; i++) {
+		delete_bytes(buf, 0, buf_len(buf));
+		r.len = 0;
+		rand_text(text, TEXT_LEN, "abc\n");
+		CHECK(insert_bytes(buf, 0, text, TEXT_LEN) == SUCCESS);
+		ref_ins(&r, 0, text, TEXT_LEN);
+
+		mc_clear(buf);
+		c.num = CURSORS + 1;
+		for (size_t j = 0; j < c.num; j++)
+			c.off[j] = rand() % (TEXT_LEN + 1);
+		size_t main_off = c.off[0];
+		buf->cursor = off_to_ptr(buf, main_off);
+		for (size_t j = 1; j < c.num; j++)
+			CHECK(mc_add(buf, c.off[j]) == SUCCESS);
+		qsort(c.off, c.num, sizeof(size_t), cmp_off);
+		c.main = 0;
+		while (c.off[c.main] != main_off)
+			c.main++;
+		merge(&c);
+		check_cursors(buf, &c);
+
+		for (int j = 0; j < EDITS; j++) {
+			char src[3];
+			size_t len = 1 + rand() % sizeof(src);
+			int op = rand() % 3;
+			rand_text(src, len, "xyz\n");
+			if (!op) {
+				CHECK(mc_insert(buf, src, len) == SUCCESS);
+				ref_insert(&r, &c, src, len);
+			} else {
+				mc_del(buf, op == 1);
+				ref_delete(&r, &c, op == 1);
+			}
+			mc_check(buf);
+			check_cursors(buf, &c);
+		}
+		check_text(buf, &r);
+	}
+
+	delete_buffer(buf);
+	free(r.p);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include "check.h"
+#include "nest.h"
+
+#define ROUNDS 20
+#define EDITS 50
+#define QUERIES 100
+#define TEXT_LEN (4 * NEST_STEP)
+#define ALPHABET "(()){}[]xy\n"
+
+// match of bracket at offset found by a scan from it, -1 if there is none
+static long scan_match(struct ref const *r, size_t off)
+{
+	static char const open[] = "([{", close[] = ")]}";
+	char const *o = strchr(open, r->p[off]);
+	char const *c = strchr(close, r->p[off]);
+	if (!r->p[off] || (!o && !c))
+		return -1;
+
+	char ob = o ? *o : open[c - close];
+	char cb = o ? close[o - open] : *c;
+	long depth = 0;
+	if (o) {
+		for (size_t i = off; i < r->len; i++) {
+			depth += (r->p[i] == ob) - (r->p[i] == cb);
+			if (!depth)
+				return i;
+		}
+	} else {
+		for (size_t i = off + 1; i--;) {
+			depth += (r->p[i] == cb) - (r->p[i] == ob);
+			if (!depth)
+				return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Text of several checkpoint blocks is edited at random places, small
+ * edits and ones longer than a block, and matches of brackets at random
+ * offsets are compared with the ones found by a plain scan.
+ */
+int main(void)
+{
+	struct buffer *buf = create_buffer();
+	char *text = malloc(TEXT_LEN);
+	struct ref r = {0};
+	CHECK(buf && buf->nest && text);
+
+	srand(1);
+	rand_text(text, TEXT_LEN, ALPHABET);
+	CHECK(insert_bytes(buf, 0, text, TEXT_LEN) == SUCCESS);
+	ref_ins(&r, 0, text, TEXT_LEN);
+
+	for (int i = 0; i < ROUNDS; i++) {
+		for (int j = 0; j < EDITS; j++)
+			rand_edit(buf, &r, ALPHABET, j ? 100 : 2 * NEST_STEP);
+		for (int j = 0; j < QUERIES; j++) {
+			size_t off = rand() % r.len;
+			CHECK(nest_match(buf, off) == scan_match(&r, off));
+		}
+	}
+	check_text(buf, &r);
+
+	delete_buffer(buf);
+	free(r.p);
+	free(text);
+	return 0;
+}
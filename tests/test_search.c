@@ -0,0 +1,58 @@
+#include "check.h"
+#include "search.h"
+
+#include <unistd.h>
+
+#define TEXT_LEN (3 * SEARCH_CHUNK + 1000)
+#define PAT "abcab"
+#define PAT_LEN (sizeof(PAT) - 1)
+
+/*
+ * Text of several search chunks with matches put across their borders is
+ * searched while the buffer is edited, matches are compared with the ones
+ * found by a scan of the text at search start.
+ */
+int main(void)
+{
+	struct buffer *buf = create_buffer();
+	char *text = malloc(TEXT_LEN);
+	size_t *offs = malloc(TEXT_LEN * sizeof(size_t));
+	CHECK(buf && text && offs);
+
+	srand(1);
+	rand_text(text, TEXT_LEN, "abcd");
+	for (size_t b = SEARCH_CHUNK; b < TEXT_LEN; b += SEARCH_CHUNK)
+		for (size_t i = 1; i < PAT_LEN; i++)
+			memcpy(text + b - i, PAT, PAT_LEN);
+	memcpy(text + TEXT_LEN - PAT_LEN, PAT, PAT_LEN);
+	CHECK(insert_bytes(buf, 0, text, TEXT_LEN) == SUCCESS);
+
+	size_t num = 0;
+	for (size_t i = 0; i + PAT_LEN <= TEXT_LEN; i++)
+		if (!memcmp(text + i, PAT, PAT_LEN))
+			offs[num++] = i;
+
+	struct search *s = search_start(buf, PAT, PAT_LEN, TEXT_LEN / 2);
+	CHECK(s);
+	CHECK(insert_bytes(buf, 0, PAT, PAT_LEN) == SUCCESS);
+	delete_bytes(buf, TEXT_LEN / 2, 1000);
+
+	int done = 0;
+	while (search_count(s, &done) < num || !done)
+		usleep(1000);
+	CHECK(search_count(s, &done) == num);
+
+	for (size_t i = 0; i < num; i++) {
+		CHECK(search_next(s, i ? offs[i - 1] + 1 : 0, 0) == (long)offs[i]);
+		CHECK(search_next(s, offs[i], 1)
+		      == (long)offs[i ? i - 1 : num - 1]);
+		CHECK(search_index(s, offs[i]) == i + 1);
+	}
+	CHECK(search_next(s, offs[num - 1] + 1, 0) == (long)offs[0]);
+
+	search_stop(s);
+	delete_buffer(buf);
+	free(offs);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include "check.h"
+#include "snap.h"
+
+#define ROUNDS 30
+#define EDITS 200
+#define KEPT 4
+#define TEXT_LEN (3 * SNAP_BLOCK + 100)
+
+static void check_snap(struct snap *s, struct ref const *r)
+{
+	char block[1000];
+	CHECK(snap_valid(s) && s->len == r->len);
+	for (size_t off = 0; off < r->len; off += sizeof(block)) {
+		size_t n = snap_read(s, off, block, sizeof(block));
+		CHECK(n == (r->len - off < sizeof(block) ? r->len - off
+		                                         : sizeof(block)));
+		CHECK(!memcmp(block, r->p + off, n));
+	}
+}
+
+/*
+ * Snapshots are taken between rounds of random edits and each must still
+ * read as the text it was taken of, also after the buffer is freed.
+ */
+int main(void)
+{
+	struct buffer *buf = create_buffer();
+	struct snap *snaps[KEPT] = {0};
+	struct ref refs[KEPT] = {{0}};
+	struct ref r = {0};
+	char *text = malloc(TEXT_LEN);
+	CHECK(buf && text);
+
+	srand(1);
+	rand_text(text, TEXT_LEN, "abcd\n");
+	CHECK(insert_bytes(buf, 0, text, TEXT_LEN) == SUCCESS);
+	ref_ins(&r, 0, text, TEXT_LEN);
+
+	for (int i = 0; i < ROUNDS; i++) {
+		int k = i % KEPT;
+		if (snaps[k])
+			snap_put(snaps[k]);
+		snaps[k] = snap_take(buf);
+		CHECK(snaps[k]);
+		refs[k].len = 0;
+		ref_ins(&refs[k], 0, r.p, r.len);
+
+		for (int j = 0; j < EDITS; j++)
+			rand_edit(buf, &r, "abcd\n", i % 5 ? 100 : 20000);
+		check_text(buf, &r);
+		for (int j = 0; j < KEPT; j++)
+			if (snaps[j])
+				check_snap(snaps[j], &refs[j]);
+	}
+
+	delete_buffer(buf);
+	for (int j = 0; j < KEPT; j++) {
+		check_snap(snaps[j], &refs[j]);
+		snap_put(snaps[j]);
+		free(refs[j].p);
+	}
+	free(r.p);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,403 @@
+#include "view.h"
+#include "buffer.h"
+#include "pcache.h"
+#include "slog.h"
+#include "rc.h"
+#include "term.h"
+#include "util.h"
+#include "utf.h"
+
+#include <ctype.h>
+#include <ncurses.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct view {
+	struct pcache *pc;
+	char const *fname;
+	size_t top;           // offset of the first shown row
+	size_t bottom;        // offset right after the last shown row
+	int rows;             // text rows, status line excluded
+	int cols;
+	char pat[FIND_MAX + 1];
+	size_t pat_len;
+	long match;           // offset of shown match, -1 if there is none
+	char *blk;            // block of file that is searched
+	char msg[COLS_MAX];   // shown instead of status until the next key
+};
+
+static void draw(struct view *v);
+static size_t row(struct view *v, size_t off, int y);
+static int symbol(struct view *v, size_t off, char *str);
+static int byte_at(struct view *v, size_t off);
+static size_t line_b(struct view *v, size_t off);
+static size_t prev_row(struct view *v, size_t off);
+static size_t row_of(struct view *v, size_t off);
+static void go_to(struct view *v);
+static void find(struct view *v, bool prev);
+static long find_next(struct view *v, size_t from);
+static long find_prev(struct view *v, size_t from);
+static bool cancelled(struct view *v, size_t done, size_t total);
+static void show(struct view *v, size_t off);
+
+int view_wanted(char const *fname)
+{
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long page = sysconf(_SC_PAGESIZE);
+	if (pages <= 0 || page <= 0)
+		return 0;
+	return get_fsize(fname) > (size_t)pages * page / 2;
+}
+
+int view_run(char const *fname, size_t mem)
+{
+	struct view v = {.fname = fname, .match = -1};
+	v.pc = pcache_open(fname, mem);
+	v.blk = malloc(VIEW_FIND_BLOCK + FIND_MAX);
+	if (!v.pc || !v.blk) {
+		log_ss("error", "view_run open fail");
+		pcache_close(v.pc);
+		free(v.blk);
+		return ERROR;
+	}
+
+	term_setup();
+	curs_set(0);
+	snprintf(v.msg, sizeof(v.msg), "%s", "Read-only view  F10-Quit  "
+	         "F11-Go to  ^F-Find  ^N-Next match  ^R-Previous match");
+
+	bool in_loop = true;
+	while (in_loop) {
+		draw(&v);
+		int ch = getch();
+		v.msg[0] = '\0';
+
+		switch (ch) {
+		case KEY_F(10):
+		case 'q':
+			in_loop = false;
+			break;
+		case KEY_DOWN:
+			if (v.bottom < v.pc->size)
+				v.top = row(&v, v.top, -1);
+			break;
+		case KEY_UP:
+			v.top = prev_row(&v, v.top);
+			break;
+		case KEY_NPAGE:
+		case ' ':
+			if (v.bottom < v.pc->size)
+				v.top = v.bottom;
+			break;
+		case KEY_PPAGE:
+			for (int i = 0; i < v.rows; i++)
+				v.top = prev_row(&v, v.top);
+			break;
+		case KEY_HOME:
+			v.top = 0;
+			break;
+		case KEY_END:
+			v.top = v.pc->size;
+			for (int i = 0; i < v.rows; i++)
+				v.top = prev_row(&v, v.top);
+			break;
+		case KEY_F(11):
+			go_to(&v);
+			break;
+		case KEY_CTRL('f'):
+			get_input("Find: ", v.pat, FIND_MAX);
+			v.pat_len = strlen(v.pat);
+			v.match = -1;
+			find(&v, false);
+			break;
+		case KEY_CTRL('n'):
+			find(&v, false);
+			break;
+		case KEY_CTRL('r'):
+			find(&v, true);
+			break;
+		}
+	}
+
+	endwin();
+	pcache_close(v.pc);
+	free(v.blk);
+	return SUCCESS;
+}
+
+static void draw(struct view *v)
+{
+	getmaxyx(stdscr, v->rows, v->cols);
+	v->rows--;            // last row is status line
+	if (v->cols < 1)
+		v->cols = 1;
+
+	erase();
+	size_t off = v->top;
+	for (int y = 0; y < v->rows; y++)
+		off = row(v, off, y);
+	v->bottom = off;
+
+	if (v->msg[0]) {
+		term_status(v->msg);
+		return;
+	}
+
+	char str[COLS_MAX];
+	size_t size = v->pc->size;
+	snprintf(str, sizeof(str), " %s  @%zu  %zu bytes  %d%%  read-only",
+	         v->fname, v->top, size,
+	         size ? (int)(100.0 * v->bottom / size) : 100);
+	term_status(str);
+}
+
+/*
+ * Offset of the row after one at off, the row is drawn at y if it's not
+ * negative. Each byte takes a column, bytes that aren't shown as text
+ * are dots, so a screen never needs more than rows * cols symbols.
+ */
+static size_t row(struct view *v, size_t off, int y)
+{
+	size_t size = v->pc->size;
+	int x = 0;
+	if (y >= 0)
+		move(y, 0);
+
+	while (off < size && x < v->cols) {
+		char str[UTF_BUF_SIZE] = {0};
+		int ch = byte_at(v, off);
+		int len = 1;
+		int w = 1;
+		if (ch < 0)
+			return size;
+		if (ch == '\n')
+			return off + 1;
+
+		if (ch == '\t') {
+			w = TAB_LEN;
+		} else if (!ISASCII(ch)) {
+			len = symbol(v, off, str);
+			if (!len) {
+				len = 1;
+				str[0] = '.';
+			}
+		} else {
+			str[0] = isprint(ch) ? ch : '.';
+		}
+
+		if (y >= 0) {
+			bool found = v->match >= 0 && off >= (size_t)v->match
+			             && off < v->match + v->pat_len;
+			if (found)
+				attron(A_REVERSE);
+			if (ch == '\t') {
+				for (int i = 0; i < TAB_LEN && x + i < v->cols; i++)
+					addch(' ');
+			} else {
+				addstr(str);
+			}
+			if (found)
+				attroff(A_REVERSE);
+		}
+
+		x += w;
+		off += len;
+	}
+	return off;
+}
+
+// utf8 symbol at offset is copied to str, returns its length or 0 if
+// the bytes aren't a valid symbol
+static int symbol(struct view *v, size_t off, char *str)
+{
+	int len = get_symb_len(byte_at(v, off));
+	if (len < 2 || len > 4)
+		return 0;
+	if (pcache_read(v->pc, off, str, len) != (size_t)len)
+		return 0;
+	for (int i = 1; i < len; i++) {
+		if (!ISFILL(str[i]))
+			return 0;
+	}
+	return len;
+}
+
+static int byte_at(struct view *v, size_t off)
+{
+	size_t len;
+	char const *p = pcache_get(v->pc, off, &len);
+	return p ? (unsigned char)*p : -1;
+}
+
+// begin of line with offset, not further back than VIEW_LINE_MAX bytes
+static size_t line_b(struct view *v, size_t off)
+{
+	size_t lim = off > VIEW_LINE_MAX ? off - VIEW_LINE_MAX : 0;
+	while (off > lim) {
+		size_t b = (off - 1) / PCACHE_PAGE * PCACHE_PAGE;
+		if (b < lim)
+			b = lim;
+
+		size_t len;
+		char const *p = pcache_get(v->pc, b, &len);
+		if (!p)
+			return off;
+		char const *nl = memrchr(p, '\n', off - b);
+		if (nl)
+			return b + (nl - p) + 1;
+		off = b;
+	}
+	return lim;
+}
+
+// rows of the line before offset are walked from its begin
+static size_t prev_row(struct view *v, size_t off)
+{
+	if (!off)
+		return 0;
+
+	size_t r = line_b(v, off - 1);
+	for (;;) {
+		size_t n = row(v, r, -1);
+		if (n >= off)
+			return r;
+		r = n;
+	}
+}
+
+static size_t row_of(struct view *v, size_t off)
+{
+	size_t r = line_b(v, off);
+	for (;;) {
+		size_t n = row(v, r, -1);
+		if (n > off || n >= v->pc->size)
+			return r;
+		r = n;
+	}
+}
+
+// line numbers aren't known, they would take reading the whole file
+static void go_to(struct view *v)
+{
+	char str[COLS_MAX] = "";
+	get_input("Go to @byte offset or percent%: ", str, sizeof(str) - 1);
+
+	size_t size = v->pc->size;
+	size_t off;
+	char *end;
+	if (str[0] == '@') {
+		off = strtoull(str + 1, NULL, 10);
+	} else {
+		double pct = strtod(str, &end);
+		if (end == str || *end != '%' || pct < 0) {
+			snprintf(v->msg, sizeof(v->msg), "%s",
+			         "Enter @byte offset or percent%");
+			return;
+		}
+		off = pct >= 100 ? size : (size_t)(pct / 100 * size);
+	}
+
+	v->top = row_of(v, off < size ? off : size);
+}
+
+// search goes from the shown match or from the top row, it doesn't wrap
+static void find(struct view *v, bool prev)
+{
+	if (!v->pat_len) {
+		snprintf(v->msg, sizeof(v->msg), "%s", "Nothing to find");
+		return;
+	}
+
+	size_t from = v->match >= 0 ? (size_t)v->match : v->top;
+	long off;
+	if (prev)
+		off = find_prev(v, from);
+	else
+		off = find_next(v, v->match >= 0 ? from + 1 : from);
+
+	if (off == -2)
+		snprintf(v->msg, sizeof(v->msg), "%s", "Search cancelled");
+	else if (off < 0)
+		snprintf(v->msg, sizeof(v->msg), "%s", "Not found");
+	else
+		show(v, off);
+}
+
+// first match at offset or after it, -2 if search was cancelled
+static long find_next(struct view *v, size_t from)
+{
+	size_t size = v->pc->size;
+	size_t k = 0;
+	for (size_t pos = from; pos < size; pos += VIEW_FIND_BLOCK) {
+		if (++k % VIEW_FIND_CHECK == 0
+		    && cancelled(v, pos - from, size - from))
+			return -2;
+
+		size_t n = pcache_read(v->pc, pos, v->blk,
+		                       VIEW_FIND_BLOCK + v->pat_len - 1);
+		char const *q = memmem(v->blk, n, v->pat, v->pat_len);
+		if (q)
+			return pos + (q - v->blk);
+		if (n < VIEW_FIND_BLOCK)
+			break;
+	}
+	return -1;
+}
+
+// last match that begins before offset, -2 if search was cancelled
+static long find_prev(struct view *v, size_t from)
+{
+	size_t k = 0;
+	for (size_t e = from; e > 0; ) {
+		if (++k % VIEW_FIND_CHECK == 0 && cancelled(v, from - e, from))
+			return -2;
+
+		size_t b = e > VIEW_FIND_BLOCK ? e - VIEW_FIND_BLOCK : 0;
+		size_t n = pcache_read(v->pc, b, v->blk,
+		                       e - b + v->pat_len - 1);
+		long last = -1;
+		char const *p = v->blk;
+		char const *end = v->blk + n;
+		while (end - p >= (long)v->pat_len) {
+			char const *q = memmem(p, end - p, v->pat, v->pat_len);
+			if (!q || (size_t)(q - v->blk) >= e - b)
+				break;
+			last = b + (q - v->blk);
+			p = q + 1;
+		}
+		if (last >= 0)
+			return last;
+		e = b;
+	}
+	return -1;
+}
+
+// progress is shown, any key cancels the search
+static bool cancelled(struct view *v, size_t done, size_t total)
+{
+	snprintf(v->msg, sizeof(v->msg),
+	         "Searching: %d%% (any key - cancel)",
+	         (int)(100.0 * done / total));
+	term_status(v->msg);
+	v->msg[0] = '\0';
+
+	nodelay(stdscr, TRUE);
+	int ch = getch();
+	nodelay(stdscr, FALSE);
+	return ch != ERR;
+}
+
+// row of the match is shown in the middle of the screen if it isn't on
+// screen yet
+static void show(struct view *v, size_t off)
+{
+	v->match = off;
+	if (off >= v->top && off < v->bottom)
+		return;
+
+	v->top = row_of(v, off);
+	for (int i = 0; i < v->rows / 2; i++)
+		v->top = prev_row(v, v->top);
+}
@@ -0,0 +1,25 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stddef.h>
+
+#define VIEW_MEM_DEF (64 * 1024 * 1024)  // page cache of the viewer
+#define VIEW_LINE_MAX (1024 * 1024)      // longer lines are cut into parts
+#define VIEW_FIND_BLOCK (1024 * 1024)    // search reads file by blocks
+#define VIEW_FIND_CHECK 64               // blocks between checks for keys
+
+/*
+ * Read-only viewer of files that are too large to be loaded. Screen is
+ * drawn from a page cache of bounded size (see pcache.h), only pages
+ * around the shown part of the file are read. Rows are found from the
+ * begin of their line, so a row above the screen is found by scanning
+ * back to the line begin, but not further than VIEW_LINE_MAX bytes.
+ */
+
+// file is larger than half of physical memory
+int view_wanted(char const *fname);
+
+// show file until F10 is pressed, mem is the page cache size in bytes
+int view_run(char const *fname, size_t mem);
+
+#endif /* VIEW_H */
@@ -0,0 +1,247 @@
+#include "window.h"
+#include "mark.h"
+#include "slog.h"
+#include "rc.h"
+
+#include <string.h>
+
+static struct window wins[WIN_MAX];
+static int num;       // number of windows
+static int active;
+
+static int layout(void);
+static void keep_pos(struct window *w);
+static void take_pos(struct window *w);
+static void drop_marks(struct window *w);
+static int draw(struct window *w, int is_active);
+
+int win_start(struct buffer *buf)
+{
+	if (!buf)
+		return ERROR;
+
+	memset(wins, 0, sizeof(wins));
+	wins[0].buf = buf;
+	num = 1;
+	active = 0;
+
+	return layout();
+}
+
+void win_end(void)
+{
+	// marks are freed with buffers
+	for (int i = 0; i < num; i++) {
+		if (wins[i].win)
+			delwin(wins[i].win);
+	}
+	memset(wins, 0, sizeof(wins));
+	num = 0;
+	active = 0;
+}
+
+struct buffer * win_buf(void)
+{
+	return num ? wins[active].buf : NULL;
+}
+
+int win_rows(void)
+{
+	if (!num || !wins[active].win)
+		return LINES - 1;
+	return getmaxy(wins[active].win) - 1;
+}
+
+int win_cols(void)
+{
+	if (!num || !wins[active].win)
+		return COLS;
+	return getmaxx(wins[active].win);
+}
+
+/*
+ * Buffer keeps positions of the window that left it, so they are used
+ * when it's shown again.
+ */
+void win_show(struct buffer *buf)
+{
+	if (!num || !buf)
+		return;
+
+	wins[active].buf = buf;
+}
+
+int win_split(void)
+{
+	if (!num || num == WIN_MAX || LINES / (num + 1) < WIN_ROWS_MIN)
+		return ERROR;
+
+	memmove(wins + active + 2, wins + active + 1,
+	        (num - active - 1) * sizeof(struct window));
+
+	struct window *w = &wins[active + 1];
+	memset(w, 0, sizeof(struct window));
+	w->buf = wins[active].buf;
+	keep_pos(w);
+	num++;
+
+	return layout();
+}
+
+int win_close(void)
+{
+	if (num < 2)
+		return ERROR;
+
+	delwin(wins[active].win);
+	memmove(wins + active, wins + active + 1,
+	        (num - active - 1) * sizeof(struct window));
+	num--;
+	memset(wins + num, 0, sizeof(struct window));
+
+	if (active == num)
+		active--;
+	take_pos(&wins[active]);
+
+	return layout();
+}
+
+void win_other(void)
+{
+	if (num < 2)
+		return;
+
+	keep_pos(&wins[active]);
+	active = (active + 1) % num;
+	take_pos(&wins[active]);
+}
+
+void win_resize(void)
+{
+	if (num && layout() != SUCCESS)
+		log_ss("error", "win_resize layout fail");
+}
+
+/*
+ * Windows only copy their changed rows to the screen, stdscr is
+ * refreshed last to put terminal cursor at the active window cursor.
+ */
+int win_draw(void)
+{
+	int rc = SUCCESS;
+	for (int i = 0; i < num; i++) {
+		if (draw(&wins[i], i == active) != SUCCESS)
+			rc = ERROR;
+		wnoutrefresh(wins[i].win);
+	}
+
+	if (num) {
+		int y, x, by, bx;
+		getyx(wins[active].win, y, x);
+		getbegyx(wins[active].win, by, bx);
+		wmove(stdscr, by + y, bx + x);
+	}
+	wnoutrefresh(stdscr);
+	doupdate();
+
+	return rc;
+}
+
+// equal heights, the last window gets the rest. Windows that don't fit
+// are closed
+static int layout(void)
+{
+	while (num > 1 && LINES / num < WIN_ROWS_MIN) {
+		int last = (active == num - 1) ? num - 2 : num - 1;
+		drop_marks(&wins[last]);
+		delwin(wins[last].win);
+		memmove(wins + last, wins + last + 1,
+		        (num - last - 1) * sizeof(struct window));
+		num--;
+		memset(wins + num, 0, sizeof(struct window));
+		if (active > last)
+			active--;
+	}
+
+	int h = LINES / num;
+	int y = 0;
+	for (int i = 0; i < num; i++) {
+		int rows = (i == num - 1) ? LINES - y : h;
+
+		if (wins[i].win)
+			delwin(wins[i].win);
+		wins[i].win = derwin(stdscr, rows, COLS, y, 0);
+		if (!wins[i].win) {
+			log_ss("error", "layout derwin fail");
+			return ERROR;
+		}
+		memset(&wins[i].st, 0, sizeof(struct disp_state));
+		y += rows;
+	}
+
+	return SUCCESS;
+}
+
+// positions of window that becomes inactive are kept in marks
+static void keep_pos(struct window *w)
+{
+	struct buffer *buf = w->buf;
+	drop_marks(w);
+
+	w->mk_cursor = mark_new(buf->marks, ptr_to_off(buf, buf->cursor));
+	w->mk_disp_b = mark_new(buf->marks, ptr_to_off(buf, buf->disp_b));
+	if (buf->sel)
+		w->mk_sel = mark_new(buf->marks, ptr_to_off(buf, buf->sel));
+}
+
+// positions of window that becomes active are moved to its buffer
+static void take_pos(struct window *w)
+{
+	struct buffer *buf = w->buf;
+	if (!w->mk_cursor || !w->mk_disp_b)
+		return;
+
+	buf->cursor = off_to_ptr(buf, mark_off(w->mk_cursor));
+	buf->disp_b = off_to_pos(buf, mark_off(w->mk_disp_b));
+	buf->sel = w->mk_sel ? off_to_pos(buf, mark_off(w->mk_sel)) : NULL;
+	drop_marks(w);
+}
+
+static void drop_marks(struct window *w)
+{
+	struct mark_set *set = w->buf->marks;
+	mark_free(set, w->mk_cursor);
+	mark_free(set, w->mk_disp_b);
+	mark_free(set, w->mk_sel);
+	w->mk_cursor = w->mk_disp_b = w->mk_sel = NULL;
+}
+
+// inactive window is drawn with its positions put into the buffer for
+// a while, additional cursors belong to the active one
+static int draw(struct window *w, int is_active)
+{
+	struct buffer *buf = w->buf;
+	if (is_active || !w->mk_cursor || !w->mk_disp_b)
+		return display(buf, w->win, &w->st);
+
+	char *cursor = buf->cursor;
+	char *disp_b = buf->disp_b;
+	char *disp_e = buf->disp_e;
+	char *sel = buf->sel;
+	struct mcursor *mc = buf->mc;
+
+	buf->cursor = off_to_ptr(buf, mark_off(w->mk_cursor));
+	buf->disp_b = off_to_pos(buf, mark_off(w->mk_disp_b));
+	buf->sel = w->mk_sel ? off_to_pos(buf, mark_off(w->mk_sel)) : NULL;
+	buf->mc = NULL;
+
+	int rc = display(buf, w->win, &w->st);
+
+	buf->cursor = cursor;
+	buf->disp_b = disp_b;
+	buf->disp_e = disp_e;
+	buf->sel = sel;
+	buf->mc = mc;
+
+	return rc;
+}
@@ -0,0 +1,63 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include "buffer.h"
+#include "display.h"
+
+#include <ncurses.h>
+
+#define WIN_MAX 8
+#define WIN_ROWS_MIN 3     // smallest window: two text rows and status
+
+/*
+ * Part of the screen that shows a buffer. Windows are stacked one under
+ * another, each is a subwindow of stdscr and draws only its damaged rows.
+ *
+ * Active window keeps its cursor, top line and selection right in the
+ * buffer, so editing functions work as usual. Other windows keep them
+ * in marks of their buffers, so they stay at the same text while the
+ * buffer is changed in the active window.
+ */
+struct window {
+	WINDOW *win;
+	struct buffer *buf;
+	struct mark *mk_cursor;   // positions of inactive window
+	struct mark *mk_disp_b;
+	struct mark *mk_sel;      // NULL if there is no selection
+	struct disp_state st;
+};
+
+// make the first window on whole screen
+int win_start(struct buffer *buf);
+
+// free all windows, buffers are left
+void win_end(void);
+
+// buffer of active window
+struct buffer * win_buf(void);
+
+// number of text rows in active window
+int win_rows(void);
+
+// number of columns of active window
+int win_cols(void);
+
+// show buffer in active window
+void win_show(struct buffer *buf);
+
+// split active window in two that show the same buffer
+int win_split(void);
+
+// close active window unless it's the last one
+int win_close(void);
+
+// make next window active
+void win_other(void);
+
+// lay out windows again after terminal size was changed
+void win_resize(void);
+
+// draw damaged parts of all windows and update terminal
+int win_draw(void);
+
+#endif /* WINDOW_H */
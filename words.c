@@ -0,0 +1,380 @@
+#include "words.h"
+#include "buffer.h"
+#include "rc.h"
+#include "slog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WORDS_NODES_INIT 1024
+
+// words of text that is fed by parts are added to (or taken from) index
+struct tok {
+	struct words *w;
+	char word[WORD_MAX];
+	size_t len;
+	int over;             // word is longer than WORD_MAX
+	int delta;
+	int rc;
+};
+
+// most frequent completions found so far
+struct best {
+	char (*out)[WORD_MAX + 1];
+	uint32_t counts[WORD_MAX];
+	size_t num;
+	size_t max;
+	char word[WORD_MAX + 1];
+};
+
+static void * build_thread(void *arg);
+static void build(struct words *w);
+static void tok_feed(struct tok *t, char const *p, size_t len);
+static void tok_flush(struct tok *t);
+static void feed_text(struct buffer const *buf, struct tok *t, size_t b,
+                      size_t e);
+static size_t word_b(struct buffer const *buf, size_t off);
+static size_t word_e(struct buffer const *buf, size_t off);
+static int add(struct words *w, char const *word, size_t len, int delta);
+static uint32_t child(struct words const *w, uint32_t n, unsigned char ch);
+static uint32_t new_node(struct words *w, uint32_t parent, unsigned char ch);
+static void collect(struct words const *w, uint32_t n, struct best *b,
+                    size_t depth);
+static void keep(struct best *b, size_t len, uint32_t count);
+static void rewrite(struct buffer *buf, size_t off, size_t len,
+                    char const *src, size_t src_len);
+
+int words_start(struct buffer *buf)
+{
+	words_stop(buf);
+
+	size_t len = buf_len(buf);
+	if (len > WORDS_TEXT_MAX) {
+		log_si("words text too large", (int)(len >> 20));
+		return SUCCESS;
+	}
+
+	struct words *w = calloc(1, sizeof(struct words));
+	if (!w)
+		return ERROR;
+	w->nodes = malloc(WORDS_NODES_INIT * sizeof(struct wnode));
+	if (!w->nodes) {
+		free(w);
+		return ERROR;
+	}
+	w->size = WORDS_NODES_INIT;
+	w->nodes[0] = (struct wnode){0, 0, 0, 0, 0};
+	w->num = 1;
+
+	w->seg[0] = buf->buf_b;
+	w->seg_len[0] = buf->gap_b - buf->buf_b;
+	w->seg[1] = buf->gap_e;
+	w->seg_len[1] = buf->buf_e - buf->gap_e;
+	buf->words = w;
+
+	if (len < WORDS_BG_MIN ||
+	    pthread_create(&w->thread, NULL, build_thread, w)) {
+		build(w);
+		return w->failed ? ERROR : SUCCESS;
+	}
+
+	w->building = 1;
+	return SUCCESS;
+}
+
+void words_wait(struct buffer const *buf)
+{
+	struct words *w = buf->words;
+	if (!w || !w->building)
+		return;
+
+	pthread_join(w->thread, NULL);
+	w->building = 0;
+	if (w->failed)
+		log_ss("error", "words build fail");
+}
+
+void words_stop(struct buffer *buf)
+{
+	if (!buf->words)
+		return;
+
+	words_wait(buf);
+	free(buf->words->nodes);
+	free(buf->words);
+	buf->words = NULL;
+}
+
+/*
+ * Run of word bytes around offset is one word before insertion, src is
+ * put in it and the run is split into words again.
+ */
+void words_ins(struct buffer *buf, size_t off, char const *src, size_t len)
+{
+	words_wait(buf);
+	struct words *w = buf->words;
+	if (!w || w->failed || !len)
+		return;
+
+	size_t b = word_b(buf, off);
+	size_t e = word_e(buf, off);
+
+	struct tok old = {.w = w, .delta = -1};
+	feed_text(buf, &old, b, e);
+	tok_flush(&old);
+
+	struct tok new = {.w = w, .delta = 1};
+	feed_text(buf, &new, b, off);
+	tok_feed(&new, src, len);
+	feed_text(buf, &new, off, e);
+	tok_flush(&new);
+
+	if (new.rc != SUCCESS) {
+		log_ss("error", "words_ins fail");
+		w->failed = 1;
+	}
+}
+
+void words_del(struct buffer *buf, size_t off, size_t len)
+{
+	rewrite(buf, off, len, NULL, 0);
+}
+
+void words_set(struct buffer *buf, size_t off, char const *src, size_t len)
+{
+	rewrite(buf, off, len, src, len);
+}
+
+size_t words_complete(struct buffer const *buf, char const *prefix,
+                      size_t len, char (*out)[WORD_MAX + 1], size_t max)
+{
+	words_wait(buf);
+	struct words const *w = buf->words;
+	if (!w || w->failed || len >= WORD_MAX || !max)
+		return 0;
+	if (max > WORD_MAX)
+		max = WORD_MAX;
+
+	uint32_t n = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (!(n = child(w, n, prefix[i])))
+			return 0;
+	}
+
+	struct best b = {.out = out, .max = max};
+	memcpy(b.word, prefix, len);
+	for (uint32_t c = w->nodes[n].child; c; c = w->nodes[c].next)
+		collect(w, c, &b, len);
+	return b.num;
+}
+
+int word_ch(unsigned char ch)
+{
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+	       (ch >= '0' && ch <= '9') || ch == '_' || ch >= 0x80;
+}
+
+static void * build_thread(void *arg)
+{
+	build(arg);
+	return NULL;
+}
+
+static void build(struct words *w)
+{
+	struct tok t = {.w = w, .delta = 1};
+	tok_feed(&t, w->seg[0], w->seg_len[0]);
+	tok_feed(&t, w->seg[1], w->seg_len[1]);
+	tok_flush(&t);
+	if (t.rc != SUCCESS)
+		w->failed = 1;
+}
+
+static void tok_feed(struct tok *t, char const *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (!word_ch(p[i])) {
+			tok_flush(t);
+		} else if (t->len < WORD_MAX) {
+			t->word[t->len++] = p[i];
+		} else {
+			t->over = 1;
+		}
+	}
+}
+
+static void tok_flush(struct tok *t)
+{
+	if (t->len && !t->over && t->rc == SUCCESS)
+		t->rc = add(t->w, t->word, t->len, t->delta);
+	t->len = 0;
+	t->over = 0;
+}
+
+// text bytes [b, e) from both sides of the gap
+static void feed_text(struct buffer const *buf, struct tok *t, size_t b,
+                      size_t e)
+{
+	size_t before_gap = buf->gap_b - buf->buf_b;
+	if (b < before_gap && b < e) {
+		size_t to = e < before_gap ? e : before_gap;
+		tok_feed(t, buf->buf_b + b, to - b);
+	}
+	if (e > before_gap) {
+		size_t from = b > before_gap ? b : before_gap;
+		tok_feed(t, buf->gap_e + (from - before_gap), e - from);
+	}
+}
+
+// begin of word bytes before offset. Scan stops after WORD_MAX bytes,
+// word is too long to be indexed then, and tokenizer sees it so too
+static size_t word_b(struct buffer const *buf, size_t off)
+{
+	size_t n = 0;
+	while (off && n <= WORD_MAX && word_ch(*off_to_ptr(buf, off - 1))) {
+		off--;
+		n++;
+	}
+	return off;
+}
+
+static size_t word_e(struct buffer const *buf, size_t off)
+{
+	size_t len = buf_len(buf);
+	size_t n = 0;
+	while (off < len && n <= WORD_MAX && word_ch(*off_to_ptr(buf, off))) {
+		off++;
+		n++;
+	}
+	return off;
+}
+
+/*
+ * Max of nodes on the path is raised when a count grows, it isn't
+ * lowered when one drops, so it's only a bound for the lookup.
+ */
+static int add(struct words *w, char const *word, size_t len, int delta)
+{
+	uint32_t path[WORD_MAX];
+	uint32_t n = 0;
+	for (size_t i = 0; i < len; i++) {
+		uint32_t c = child(w, n, word[i]);
+		if (!c && delta < 0)
+			return SUCCESS;
+		if (!c && !(c = new_node(w, n, word[i])))
+			return ERROR;
+		path[i] = n = c;
+	}
+
+	struct wnode *nd = &w->nodes[n];
+	if (delta < 0) {
+		if (nd->count)
+			nd->count--;
+		return SUCCESS;
+	}
+
+	nd->count++;
+	for (size_t i = 0; i < len; i++) {
+		if (w->nodes[path[i]].max < nd->count)
+			w->nodes[path[i]].max = nd->count;
+	}
+	return SUCCESS;
+}
+
+static uint32_t child(struct words const *w, uint32_t n, unsigned char ch)
+{
+	uint32_t c = w->nodes[n].child;
+	while (c && w->nodes[c].ch != ch)
+		c = w->nodes[c].next;
+	return c;
+}
+
+static uint32_t new_node(struct words *w, uint32_t parent, unsigned char ch)
+{
+	if (w->num == w->size) {
+		if (w->size > UINT32_MAX / 2)
+			return 0;
+		struct wnode *p = realloc(w->nodes,
+		                          2 * w->size * sizeof(struct wnode));
+		if (!p)
+			return 0;
+		w->nodes = p;
+		w->size *= 2;
+	}
+
+	uint32_t n = w->num++;
+	w->nodes[n] = (struct wnode){0, w->nodes[parent].child, 0, 0, ch};
+	w->nodes[parent].child = n;
+	return n;
+}
+
+// subtrees that can't beat the worst of max words found are skipped
+static void collect(struct words const *w, uint32_t n, struct best *b,
+                    size_t depth)
+{
+	struct wnode const *nd = &w->nodes[n];
+	if (b->num == b->max && nd->max < b->counts[b->num - 1])
+		return;
+
+	b->word[depth] = nd->ch;
+	if (nd->count)
+		keep(b, depth + 1, nd->count);
+	for (uint32_t c = nd->child; c; c = w->nodes[c].next)
+		collect(w, c, b, depth + 1);
+}
+
+// word is put in sorted list, ties go in alphabetical order
+static void keep(struct best *b, size_t len, uint32_t count)
+{
+	b->word[len] = '\0';
+	size_t i = b->num;
+	while (i && (b->counts[i - 1] < count ||
+	             (b->counts[i - 1] == count &&
+	              strcmp(b->out[i - 1], b->word) > 0)))
+		i--;
+	if (i == b->max)
+		return;
+
+	size_t last = b->num < b->max ? b->num : b->max - 1;
+	memmove(b->out + i + 1, b->out + i, (last - i) * sizeof(b->out[0]));
+	memmove(b->counts + i + 1, b->counts + i,
+	        (last - i) * sizeof(b->counts[0]));
+	memcpy(b->out[i], b->word, len + 1);
+	b->counts[i] = count;
+	if (b->num < b->max)
+		b->num++;
+}
+
+/*
+ * Words in the range and ones it cuts are taken out, the two ends that
+ * are left become one run with src between them.
+ */
+static void rewrite(struct buffer *buf, size_t off, size_t len,
+                    char const *src, size_t src_len)
+{
+	words_wait(buf);
+	struct words *w = buf->words;
+	size_t text_len = buf_len(buf);
+	if (!w || w->failed || !len || off >= text_len)
+		return;
+	if (len > text_len - off)
+		len = text_len - off;
+
+	size_t b = word_b(buf, off);
+	size_t e = word_e(buf, off + len);
+
+	struct tok old = {.w = w, .delta = -1};
+	feed_text(buf, &old, b, e);
+	tok_flush(&old);
+
+	struct tok new = {.w = w, .delta = 1};
+	feed_text(buf, &new, b, off);
+	tok_feed(&new, src, src_len);
+	feed_text(buf, &new, off + len, e);
+	tok_flush(&new);
+
+	if (new.rc != SUCCESS) {
+		log_ss("error", "words rewrite fail");
+		w->failed = 1;
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef WORDS_H
+#define WORDS_H
+
+#include "buffer.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORD_MAX 64                         // longer words aren't indexed
+#define WORDS_TEXT_MAX (256 * 1024 * 1024)  // larger text has no index
+#define WORDS_BG_MIN (4 * 1024 * 1024)      // text indexed in background
+
+// trie node, 0 is the root and means no node in links
+struct wnode {
+	uint32_t child;       // first child
+	uint32_t next;        // next sibling
+	uint32_t count;       // occurrences of word that ends here
+	uint32_t max;         // not less than any count in subtree
+	unsigned char ch;
+};
+
+/*
+ * Word frequency trie of the text, words are runs of letters, digits,
+ * '_' and non-ascii bytes. It's built after the file is loaded, in
+ * background if text is large, then functions that change the text or
+ * move it in memory wait for it like for line index.
+ *
+ * An edit changes only the words it touches: the run of word bytes
+ * around the edit is taken out before and put back after it. Nodes of
+ * words that are gone are kept, their count is 0.
+ */
+struct words {
+	struct wnode *nodes;
+	uint32_t num;
+	uint32_t size;        // allocated number of nodes
+	char const *seg[2];   // text parts that are being indexed
+	size_t seg_len[2];
+	int failed;           // no memory while building
+	int building;         // thread is running and should be joined
+	pthread_t thread;
+};
+
+// index words of loaded text
+int words_start(struct buffer *buf);
+
+// wait until background indexing is finished
+void words_wait(struct buffer const *buf);
+
+// wait for indexing and free the index
+void words_stop(struct buffer *buf);
+
+// len bytes of src are going to be inserted at offset
+void words_ins(struct buffer *buf, size_t off, char const *src, size_t len);
+
+// len bytes at offset are going to be deleted
+void words_del(struct buffer *buf, size_t off, size_t len);
+
+// len bytes at offset are going to be overwritten with ones of src
+void words_set(struct buffer *buf, size_t off, char const *src, size_t len);
+
+// up to max most frequent words that start with len bytes of prefix and
+// are longer than it, they're written to out sorted by frequency.
+// Returns number of words
+size_t words_complete(struct buffer const *buf, char const *prefix,
+                      size_t len, char (*out)[WORD_MAX + 1], size_t max);
+
+// byte could be part of a word
+int word_ch(unsigned char ch);
+
+#endif /* WORDS_H */